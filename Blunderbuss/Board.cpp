@@ -2,12 +2,23 @@
 #include "MoveBitboards.h"
 #include "RookMagic.h"
 #include "BishopMagic.h"
+#include "TT.h"
+#include "PieceSquareTables.h"
+#include "Pawns.h"
+#include "Material.h"
+#include "Evaluate.h"
+#include "EvalCache.h"
+#include "LargePages.h"
+#include "ThreadPool.h"
 #include <iostream>
 #include <intrin.h>
 #include <stdlib.h>
 #include <sstream>
 #include <vector>
 #include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <memory>
 
 // Inline helper to pop the least-significant 1 bit from a bitboard.
 // Returns the index of the bit that was removed.
@@ -32,10 +43,224 @@ inline uint64_t GetOccupancy(Board* board, bool color)
         board->pieces[color][5];
 }
 
+// Zobrist keys: one per (color, piece, square), castling right, en passant file and side to move
+uint64_t zobristPieces[2][6][64];
+uint64_t zobristCastling[4];
+uint64_t zobristEnPassant[8];
+uint64_t zobristSide;
+
+void InitZobrist()
+{
+    static bool initialized = false;
+    if (initialized) return;
+    initialized = true;
+
+    // Fixed-seed xorshift so keys are the same on every run
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    auto next = [&seed]() {
+        seed ^= seed >> 12;
+        seed ^= seed << 25;
+        seed ^= seed >> 27;
+        return seed * 0x2545F4914F6CDD1DULL;
+    };
+
+    for (int c = 0; c < 2; ++c)
+        for (int p = 0; p < 6; ++p)
+            for (int sq = 0; sq < 64; ++sq)
+                zobristPieces[c][p][sq] = next();
+    for (int i = 0; i < 4; ++i)
+        zobristCastling[i] = next();
+    for (int i = 0; i < 8; ++i)
+        zobristEnPassant[i] = next();
+    zobristSide = next();
+}
+
+// Computes the Zobrist key of a position from scratch
+uint64_t ComputeKey(Board* board)
+{
+    uint64_t key = 0;
+    for (int c = 0; c < 2; ++c)
+    {
+        for (int p = 0; p < 6; ++p)
+        {
+            uint64_t bb = board->pieces[c][p];
+            while (bb)
+                key ^= zobristPieces[c][p][pop_lsb(bb)];
+        }
+    }
+    for (int i = 0; i < 4; ++i)
+        if (board->castling[i])
+            key ^= zobristCastling[i];
+    if (board->en_passant)
+    {
+        uint64_t ep = board->en_passant;
+        key ^= zobristEnPassant[pop_lsb(ep) % 8];
+    }
+    if (board->turn)
+        key ^= zobristSide;
+    return key;
+}
+
+// The material key hashes piece counts: the n-th piece of a kind adds zobristPieces[color][piece][n - 1]
+uint64_t ComputeMaterialKey(Board* board)
+{
+    uint64_t key = 0;
+    for (int c = 0; c < 2; ++c)
+        for (int p = 0; p < 6; ++p)
+            for (int n = 0; n < (int)__popcnt64(board->pieces[c][p]); ++n)
+                key ^= zobristPieces[c][p][n];
+    return key;
+}
+
+uint64_t ComputePawnKey(Board* board)
+{
+    uint64_t key = 0;
+    for (int c = 0; c < 2; ++c)
+    {
+        uint64_t bb = board->pieces[c][0];
+        while (bb)
+            key ^= zobristPieces[c][0][pop_lsb(bb)];
+    }
+    return key;
+}
+
+// Cuckoo tables of every reversible non-pawn move, keyed by the Zobrist difference it
+// makes (both piece squares and the side to move), see HasGameCycle
+uint64_t cuckooKeys[8192];
+uint16_t cuckooMoves[8192]; // from | to << 6
+uint64_t betweenMasks[64][64]; // squares strictly between two aligned squares
+
+inline int CuckooH1(uint64_t key) { return key & 0x1FFF; }
+inline int CuckooH2(uint64_t key) { return (key >> 16) & 0x1FFF; }
+
+void InitCuckoo()
+{
+    static bool initialized = false;
+    if (initialized) return;
+    initialized = true;
+
+    // A ray from s1 through s2 is the squares between, s2 itself, and the same ray from s2
+    uint64_t* rays[8] = { rook_moves_up, rook_moves_down, rook_moves_left, rook_moves_right,
+                          bishop_moves_up, bishop_moves_down, bishop_moves_left, bishop_moves_right };
+    memset(betweenMasks, 0, sizeof(betweenMasks));
+    for (int s1 = 0; s1 < 64; ++s1)
+        for (int s2 = 0; s2 < 64; ++s2)
+            for (uint64_t* ray : rays)
+                if (ray[s1] & (1ULL << s2))
+                    betweenMasks[s1][s2] = ray[s1] & ~ray[s2] & ~(1ULL << s2);
+
+    memset(cuckooKeys, 0, sizeof(cuckooKeys));
+    memset(cuckooMoves, 0, sizeof(cuckooMoves));
+    for (int color = 0; color < 2; ++color)
+    {
+        for (int pieceType = 1; pieceType < 6; ++pieceType)
+        {
+            for (int s1 = 0; s1 < 64; ++s1)
+            {
+                // Attacks on an empty board
+                uint64_t diagonals = bishop_moves_up[s1] | bishop_moves_down[s1] | bishop_moves_left[s1] | bishop_moves_right[s1];
+                uint64_t lines = rook_moves_up[s1] | rook_moves_down[s1] | rook_moves_left[s1] | rook_moves_right[s1];
+                uint64_t attacks = 0;
+                switch (pieceType)
+                {
+                case 1: attacks = knight_moves[s1]; break;
+                case 2: attacks = diagonals; break;
+                case 3: attacks = lines; break;
+                case 4: attacks = diagonals | lines; break;
+                case 5: attacks = king_moves[s1]; break;
+                }
+
+                for (int s2 = s1 + 1; s2 < 64; ++s2)
+                {
+                    if (!(attacks & (1ULL << s2)))
+                        continue;
+
+                    uint16_t move = (uint16_t)(s1 | (s2 << 6));
+                    uint64_t key = zobristPieces[color][pieceType][s1] ^ zobristPieces[color][pieceType][s2] ^ zobristSide;
+
+                    // Cuckoo insertion: displace the occupant to its other slot until a free one is found
+                    int i = CuckooH1(key);
+                    while (true)
+                    {
+                        std::swap(cuckooKeys[i], key);
+                        std::swap(cuckooMoves[i], move);
+                        if (move == 0)
+                            break;
+                        i = (i == CuckooH1(key)) ? CuckooH2(key) : CuckooH1(key);
+                    }
+                }
+            }
+        }
+    }
+}
+
+bool IsDraw(Board* board, int ply)
+{
+    if (board->halfmove >= 100)
+        return true;
+
+    // Only positions since the last irreversible move can repeat, and only with the same side to move
+    int end = std::min(board->halfmove, board->gamePly);
+    bool seenBeforeRoot = false;
+    for (int i = 4; i <= end; i += 2)
+    {
+        if (board->history[board->gamePly - i] == board->key)
+        {
+            if (i < ply || seenBeforeRoot)
+                return true;
+            seenBeforeRoot = true;
+        }
+    }
+    return false;
+}
+
+bool HasGameCycle(Board* board, int ply)
+{
+    int end = std::min(board->halfmove, board->gamePly);
+    if (end < 3)
+        return false;
+
+    // Only repetitions inside the search tree are detected, so i < ply bounds the scan
+    end = std::min(end, ply - 1);
+    uint64_t occupancy = GetOccupancy(board, 0) | GetOccupancy(board, 1);
+    for (int i = 3; i <= end; i += 2)
+    {
+        uint64_t moveKey = board->key ^ board->history[board->gamePly - i];
+        int j = CuckooH1(moveKey);
+        if (cuckooKeys[j] != moveKey)
+        {
+            j = CuckooH2(moveKey);
+            if (cuckooKeys[j] != moveKey)
+                continue;
+        }
+
+        // The move reaching the earlier position must not be blocked
+        int s1 = cuckooMoves[j] & 63;
+        int s2 = cuckooMoves[j] >> 6;
+        if (!(betweenMasks[s1][s2] & occupancy))
+            return true;
+    }
+    return false;
+}
+
+void RebaseHistory(Board* board)
+{
+    // A repetition can only reach back to the last irreversible move, and at most 100 plies
+    // before the fifty-move rule decides anyway
+    int keep = std::min(std::min(board->halfmove, 100), board->gamePly);
+    memmove(board->history, board->history + board->gamePly - keep, (keep + 1) * sizeof(uint64_t));
+    board->gamePly = keep;
+}
+
+thread_local SearchStats searchStats;
+
 // Initialize the board with starting positions
 Board* InitBoard() {
+    InitZobrist();
+    InitAttackTables();
+    InitCuckoo();
     Board* board = new Board();
-    LoadFEN(board, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+    LoadFEN(board, START_FEN);
     return board;
 }
 
@@ -46,6 +271,16 @@ Snapshot MakeSnapshot(Board* board)
     memcpy(snap.pieces, board->pieces, 2 * 6 * sizeof(uint64_t));
     memcpy(snap.castling, board->castling, 4 * sizeof(bool));
     snap.en_passant = board->en_passant;
+    snap.key = board->key;
+    snap.pawnKey = board->pawnKey;
+    snap.materialKey = board->materialKey;
+    snap.halfmove = board->halfmove;
+    snap.fullmove = board->fullmove;
+    snap.gamePly = board->gamePly;
+    snap.psqtMg = board->psqtMg;
+    snap.psqtEg = board->psqtEg;
+    snap.phase = board->phase;
+    snap.accIndex = board->accIndex;
     return snap;
 }
 
@@ -82,37 +317,84 @@ void PrintBoard(Board* board)
 }
 
 
-uint64_t GetRookMoves(Board* board, int square, bool color)
+// The magic attack tables, copied to large pages by InitAttackTables when the OS allows it.
+// The rook table alone is megabytes, probed at random by every slider lookup.
+typedef uint64_t RookTableRow[sizeof(rookMagicTable[0]) / sizeof(uint64_t)];
+typedef uint64_t BishopTableRow[sizeof(bishopMagicTable[0]) / sizeof(uint64_t)];
+static const RookTableRow* rookAttackTable = rookMagicTable;
+static const BishopTableRow* bishopAttackTable = bishopMagicTable;
+static bool attackTablesLargePages = false;
+
+void InitAttackTables()
 {
-    uint64_t occupancy = GetOccupancy(board, color) | GetOccupancy(board, !color);
-    uint64_t myOccupancy = GetOccupancy(board, color);
-    uint64_t moves = 0;
+    static bool initialized = false;
+    if (initialized)
+        return;
+    initialized = true;
+
+    char* memory = (char*)AllocateLarge(sizeof(rookMagicTable) + sizeof(bishopMagicTable));
+    if (!memory)
+        return;
+    memcpy(memory, rookMagicTable, sizeof(rookMagicTable));
+    memcpy(memory + sizeof(rookMagicTable), bishopMagicTable, sizeof(bishopMagicTable));
+    if (!HasLargePages(memory))
+    {
+        // The tables in the binary are as good as a copy on ordinary pages
+        FreeLarge(memory);
+        return;
+    }
+    rookAttackTable = (const RookTableRow*)memory;
+    bishopAttackTable = (const BishopTableRow*)(memory + sizeof(rookMagicTable));
+    attackTablesLargePages = true;
+}
+
+bool AttackTablesLargePages()
+{
+    return attackTablesLargePages;
+}
 
+// Magic lookup of the squares a rook on square attacks, occupied squares included
+inline uint64_t RookAttacksInline(int square, uint64_t occupancy)
+{
     occupancy = rookMagicMask[square] & occupancy;
 	uint64_t magicNumber = rookMagics[square];
 	uint64_t occupancyIndex = (occupancy * magicNumber) >> (64 - rookMagicBits);
-    
-	moves = rookMagicTable[square][occupancyIndex];
-	moves &= ~myOccupancy; // Remove squares occupied by friendly pieces
+	return rookAttackTable[square][occupancyIndex];
+}
 
-    return moves;
+inline uint64_t BishopAttacksInline(int square, uint64_t occupancy)
+{
+    occupancy = bishopMagicMask[square] & occupancy;
+    uint64_t magicNumber = bishopMagics[square];
+    uint64_t occupancyIndex = (occupancy * magicNumber) >> (64 - bishopMagicBits);
+    return bishopAttackTable[square][occupancyIndex];
 }
 
+uint64_t RookAttacks(int square, uint64_t occupancy)
+{
+    return RookAttacksInline(square, occupancy);
+}
 
-uint64_t GetBishopMoves(Board* board, int square, bool color)
+uint64_t BishopAttacks(int square, uint64_t occupancy)
+{
+    return BishopAttacksInline(square, occupancy);
+}
+
+uint64_t GetRookMoves(Board* board, int square, bool color)
 {
-    uint64_t occupancy = GetOccupancy(board, color) | GetOccupancy(board, !color);
     uint64_t myOccupancy = GetOccupancy(board, color);
-    uint64_t moves = 0;
+    uint64_t occupancy = myOccupancy | GetOccupancy(board, !color);
 
-    occupancy = bishopMagicMask[square] & occupancy;
-    uint64_t magicNumber = bishopMagics[square];
-    uint64_t occupancyIndex = (occupancy * magicNumber) >> (64 - bishopMagicBits);
+	return RookAttacksInline(square, occupancy) & ~myOccupancy; // Remove squares occupied by friendly pieces
+}
 
-    moves = bishopMagicTable[square][occupancyIndex];
-    moves &= ~myOccupancy; // Remove squares occupied by friendly pieces
 
-    return moves;
+uint64_t GetBishopMoves(Board* board, int square, bool color)
+{
+    uint64_t myOccupancy = GetOccupancy(board, color);
+    uint64_t occupancy = myOccupancy | GetOccupancy(board, !color);
+
+    return BishopAttacksInline(square, occupancy) & ~myOccupancy; // Remove squares occupied by friendly pieces
 }
 
 
@@ -181,11 +463,104 @@ uint64_t GetPawnMoves(Board* board, int square, bool color, bool onlyCaptures)
     return moves;
 }
 
+void ComputeAttackInfo(Board* board, AttackInfo& ai)
+{
+    ai.colorOccupancy[0] = GetOccupancy(board, 0);
+    ai.colorOccupancy[1] = GetOccupancy(board, 1);
+    ai.occupancy = ai.colorOccupancy[0] | ai.colorOccupancy[1];
+
+    for (int color = 0; color < 2; ++color)
+    {
+        ai.all[color] = 0;
+        ai.doubled[color] = 0;
+
+        // Pawns attack as a set, the two capture directions can overlap
+        uint64_t pawnAttacks = 0;
+        uint64_t pawns = board->pieces[color][0];
+        while (pawns)
+        {
+            int square = pop_lsb(pawns);
+            uint64_t attacks = color == 0 ? pawn_white_capture_moves[square] : pawn_black_capture_moves[square];
+            ai.pieceAttacks[square] = attacks;
+            ai.doubled[color] |= pawnAttacks & attacks;
+            pawnAttacks |= attacks;
+        }
+        ai.byPiece[color][0] = pawnAttacks;
+        ai.all[color] = pawnAttacks;
+
+        for (int pieceType = 1; pieceType < 6; ++pieceType)
+        {
+            uint64_t pieceTypeAttacks = 0;
+            uint64_t pieces = board->pieces[color][pieceType];
+            while (pieces)
+            {
+                int square = pop_lsb(pieces);
+                uint64_t attacks = 0;
+                switch (pieceType)
+                {
+                case 1: attacks = knight_moves[square]; break;
+                case 2: attacks = BishopAttacksInline(square, ai.occupancy); break;
+                case 3: attacks = RookAttacksInline(square, ai.occupancy); break;
+                case 4: attacks = BishopAttacksInline(square, ai.occupancy) | RookAttacksInline(square, ai.occupancy); break;
+                case 5: attacks = king_moves[square]; break;
+                }
+                ai.pieceAttacks[square] = attacks;
+                ai.doubled[color] |= ai.all[color] & attacks;
+                ai.all[color] |= attacks;
+                pieceTypeAttacks |= attacks;
+            }
+            ai.byPiece[color][pieceType] = pieceTypeAttacks;
+        }
+
+        uint64_t king = board->pieces[color][5];
+        ai.kingZone[color] = king ? (king_moves[pop_lsb(king)] | board->pieces[color][5]) : 0;
+    }
+
+    // Checkers and pins against the king of the side to move
+    int us = board->turn;
+    int them = !us;
+    ai.checkers = 0;
+    ai.pinned = 0;
+    uint64_t king = board->pieces[us][5];
+    if (!king)
+        return;
+    int kingSquare = pop_lsb(king);
+
+    uint64_t rookLike = board->pieces[them][3] | board->pieces[them][4];
+    uint64_t bishopLike = board->pieces[them][2] | board->pieces[them][4];
+    uint64_t kingPawnAttacks = us == 0 ? pawn_white_capture_moves[kingSquare] : pawn_black_capture_moves[kingSquare];
+
+    ai.checkers = (kingPawnAttacks & board->pieces[them][0])
+                | (knight_moves[kingSquare] & board->pieces[them][1])
+                | (BishopAttacksInline(kingSquare, ai.occupancy) & bishopLike)
+                | (RookAttacksInline(kingSquare, ai.occupancy) & rookLike);
+
+    // Sliders that would attack the king if only their own pieces were on the board
+    uint64_t snipers = (RookAttacksInline(kingSquare, ai.colorOccupancy[them]) & rookLike)
+                     | (BishopAttacksInline(kingSquare, ai.colorOccupancy[them]) & bishopLike);
+    while (snipers)
+    {
+        uint64_t blockers = betweenMasks[kingSquare][pop_lsb(snipers)] & ai.occupancy;
+        if (blockers && !(blockers & (blockers - 1)))
+            ai.pinned |= blockers & ai.colorOccupancy[us];
+    }
+}
+
 std::vector<Move> GetMovesSide(Board* board, bool color)
+{
+    AttackInfo ai;
+    ComputeAttackInfo(board, ai);
+    return GetMovesSide(board, color, ai);
+}
+
+std::vector<Move> GetMovesSide(Board* board, bool color, const AttackInfo& ai)
 {
     std::vector<Move> moves;
     moves.reserve(100);
 
+    uint64_t myOccupancy = ai.colorOccupancy[color];
+    uint64_t opOccupancy = ai.colorOccupancy[!color];
+
     for (int pieceType = 0; pieceType < 6; pieceType++)
     {
         uint64_t pieces = board->pieces[color][pieceType];
@@ -194,26 +569,28 @@ std::vector<Move> GetMovesSide(Board* board, bool color)
         {
             int fromSquare = pop_lsb(pieces);
             uint64_t pieceMoves = 0;
-            switch (pieceType) {
-            case 0:
-                pieceMoves = GetPawnMoves(board, fromSquare, color, false);
-                break;
-            case 1:
-                pieceMoves = GetKnightMoves(board, fromSquare, color);
-                break;
-            case 2:
-                pieceMoves = GetBishopMoves(board, fromSquare, color);
-                break;
-            case 3:
-                pieceMoves = GetRookMoves(board, fromSquare, color);
-                break;
-            case 4:
-                // Queen moves: union of bishop and rook moves.
-                pieceMoves = GetBishopMoves(board, fromSquare, color) | GetRookMoves(board, fromSquare, color);
-                break;
-            case 5:
+            if (pieceType == 0)
+            {
+                pieceMoves = ai.pieceAttacks[fromSquare] & (opOccupancy | board->en_passant);
+
+                // Single push, and double push from the starting rank through an empty square
+                int forward = color == 0 ? 8 : -8;
+                int startRank = color == 0 ? 1 : 6;
+                uint64_t single = 1ULL << (fromSquare + forward);
+                if (!(single & ai.occupancy))
+                {
+                    pieceMoves |= single;
+                    if (fromSquare / 8 == startRank && !((1ULL << (fromSquare + 2 * forward)) & ai.occupancy))
+                        pieceMoves |= 1ULL << (fromSquare + 2 * forward);
+                }
+            }
+            else if (pieceType == 5)
+            {
                 pieceMoves = GetKingMoves(board, fromSquare, color);
-                break;
+            }
+            else
+            {
+                pieceMoves = ai.pieceAttacks[fromSquare] & ~myOccupancy;
             }
 
             // Iterate over each destination square.
@@ -277,6 +654,48 @@ std::vector<Move> GetMovesSide(Board* board, bool color)
 }
 
 
+// Adds (sign 1) or removes (sign -1) a piece's contribution to the piece-square scores and phase
+inline void UpdatePSQT(Board* board, int color, int pieceType, int square, int sign)
+{
+    int index = color == 0 ? square ^ 56 : square;
+    int s = color == 0 ? sign : -sign;
+    board->psqtMg += s * (mgPieceValue[pieceType] + mgPieceSquare[pieceType][index]);
+    board->psqtEg += s * (egPieceValue[pieceType] + egPieceSquare[pieceType][index]);
+    board->phase += sign * phaseIncrement[pieceType];
+}
+
+void ComputePSQT(Board* board, int& mg, int& eg, int& phase)
+{
+    mg = 0;
+    eg = 0;
+    phase = 0;
+    for (int c = 0; c < 2; ++c)
+    {
+        for (int p = 0; p < 6; ++p)
+        {
+            uint64_t bb = board->pieces[c][p];
+            while (bb)
+            {
+                int square = pop_lsb(bb);
+                int index = c == 0 ? square ^ 56 : square;
+                int s = c == 0 ? 1 : -1;
+                mg += s * (mgPieceValue[p] + mgPieceSquare[p][index]);
+                eg += s * (egPieceValue[p] + egPieceSquare[p][index]);
+                phase += phaseIncrement[p];
+            }
+        }
+    }
+}
+
+inline void AddDirtyPiece(DirtyPiece& dirty, int color, int piece, int from, int to)
+{
+    dirty.color[dirty.count] = color;
+    dirty.piece[dirty.count] = piece;
+    dirty.from[dirty.count] = from;
+    dirty.to[dirty.count] = to;
+    dirty.count++;
+}
+
 void MakeMove(Board* board, Move move)
 {
     int color = board->turn ? 1 : 0;
@@ -284,33 +703,68 @@ void MakeMove(Board* board, Move move)
     int pieceType = move.pieceType;
     if (pieceType == -1) return;
 
+    // Only a long line of moves outside the search fills the accumulator stack, nothing will
+    // unmake them. The rebase computes the top entry, so it has to see the position before the move.
+    if (nnueEnabled && board->accIndex + 1 >= NNUE_STACK_SIZE)
+        RebaseAccumulator(board);
+
     uint64_t fromMask = 1ULL << move.from;
     uint64_t toMask = 1ULL << move.to;
 
+    uint64_t key = board->key;
+    uint64_t pawnKey = board->pawnKey;
+
+    // The moved piece goes first, the accumulator update checks it for a king move
+    DirtyPiece dirty;
+    dirty.count = 0;
+    bool promotion = move.special >= 4 && move.special <= 7;
+    AddDirtyPiece(dirty, color, pieceType, move.from, promotion ? -1 : move.to);
+
+    // Pawn moves reset the fifty-move counter, so do captures below.
+    board->halfmove = (pieceType == 0) ? 0 : board->halfmove + 1;
+    if (color == 1)
+        board->fullmove++;
+
     // Remove piece from origin square.
     board->pieces[color][pieceType] ^= fromMask;
+    key ^= zobristPieces[color][pieceType][move.from];
+    UpdatePSQT(board, color, pieceType, move.from, -1);
+    if (pieceType == 0)
+        pawnKey ^= zobristPieces[color][0][move.from];
 
     // Handle captures (including en passant).
     uint64_t captureMask = toMask;
+    int captureSquare = move.to;
     if (move.special == 2)
     {
         captureMask = (opponentColor == 1) ? (toMask >> 8) : (toMask << 8);
+        captureSquare = (opponentColor == 1) ? (move.to - 8) : (move.to + 8);
     }
     for (int i = 0; i < 6; ++i)
     {
         if (board->pieces[opponentColor][i] & captureMask)
         {
             board->pieces[opponentColor][i] ^= captureMask;
+            key ^= zobristPieces[opponentColor][i][captureSquare];
+            UpdatePSQT(board, opponentColor, i, captureSquare, -1);
+            if (i == 0)
+                pawnKey ^= zobristPieces[opponentColor][0][captureSquare];
+            board->materialKey ^= zobristPieces[opponentColor][i][__popcnt64(board->pieces[opponentColor][i])];
+            AddDirtyPiece(dirty, opponentColor, i, captureSquare, -1);
+            board->halfmove = 0;
             break; // only one piece captured per move
         }
     }
 
     // Update castling rights based on rook/king movement.
-    static const int rookSquares[4] = { 0, 7, 56, 63 };
+    static const int rookSquares[4] = { 7, 0, 63, 56 }; // indexed like castling
     for (int i = 0; i < 4; ++i)
     {
-        if (move.from == rookSquares[i] || move.to == rookSquares[i])
+        if ((move.from == rookSquares[i] || move.to == rookSquares[i]) && board->castling[i])
+        {
             board->castling[i] = false;
+            key ^= zobristCastling[i];
+        }
     }
 
     // Handle castling move: move the rook accordingly.
@@ -322,29 +776,68 @@ void MakeMove(Board* board, Move move)
         uint64_t rookToMask = 1ULL << rookTo;
         board->pieces[color][3] ^= rookFromMask;
         board->pieces[color][3] |= rookToMask;
+        key ^= zobristPieces[color][3][rookFrom] ^ zobristPieces[color][3][rookTo];
+        UpdatePSQT(board, color, 3, rookFrom, -1);
+        UpdatePSQT(board, color, 3, rookTo, 1);
+        AddDirtyPiece(dirty, color, 3, rookFrom, rookTo);
     }
 
     // If the king moved, remove both castling rights for that side.
     if (pieceType == 5)
     {
-        board->castling[color * 2] = false;
-        board->castling[color * 2 + 1] = false;
+        for (int i = color * 2; i < color * 2 + 2; ++i)
+        {
+            if (board->castling[i])
+            {
+                board->castling[i] = false;
+                key ^= zobristCastling[i];
+            }
+        }
     }
 
     // Handle promotion.
-    if (move.special >= 4 && move.special <= 7)
+    if (promotion)
     {
         static const int promotionMap[] = { 4, 1, 3, 2 }; // Q, N, R, B respectively
-        board->pieces[color][promotionMap[move.special - 4]] |= toMask;
+        int promoted = promotionMap[move.special - 4];
+        board->materialKey ^= zobristPieces[color][0][__popcnt64(board->pieces[color][0])]
+                            ^ zobristPieces[color][promoted][__popcnt64(board->pieces[color][promoted])];
+        board->pieces[color][promoted] |= toMask;
+        key ^= zobristPieces[color][promoted][move.to];
+        UpdatePSQT(board, color, promoted, move.to, 1);
+        AddDirtyPiece(dirty, color, promoted, -1, move.to);
     }
     else
     {
         board->pieces[color][pieceType] |= toMask;
+        key ^= zobristPieces[color][pieceType][move.to];
+        UpdatePSQT(board, color, pieceType, move.to, 1);
+        if (pieceType == 0)
+            pawnKey ^= zobristPieces[color][0][move.to];
     }
 
     // Set en passant square.
+    if (board->en_passant)
+    {
+        uint64_t ep = board->en_passant;
+        key ^= zobristEnPassant[pop_lsb(ep) % 8];
+    }
     board->en_passant = (move.enPassantSquare != -1) ? (1ULL << move.enPassantSquare) : 0;
+    if (move.enPassantSquare != -1)
+        key ^= zobristEnPassant[move.enPassantSquare % 8];
+
     board->turn ^= 1;
+    board->key = key ^ zobristSide;
+    board->pawnKey = pawnKey;
+
+    // Like the accumulator stack, a full history only comes from a long line of moves outside the search
+    if (board->gamePly + 1 >= MAX_GAME_PLY)
+        RebaseHistory(board);
+    board->gamePly++;
+    board->history[board->gamePly] = board->key;
+
+    if (nnueEnabled)
+        PushAccumulator(board, dirty);
 }
 
 void UnmakeMove(Board* board, Snapshot snap)
@@ -353,6 +846,16 @@ void UnmakeMove(Board* board, Snapshot snap)
     memcpy(board->pieces, snap.pieces, 2 * 6 * sizeof(uint64_t));
     memcpy(board->castling, snap.castling, 4 * sizeof(bool));
     board->en_passant = snap.en_passant;
+    board->key = snap.key;
+    board->pawnKey = snap.pawnKey;
+    board->materialKey = snap.materialKey;
+    board->halfmove = snap.halfmove;
+    board->fullmove = snap.fullmove;
+    board->gamePly = snap.gamePly;
+    board->psqtMg = snap.psqtMg;
+    board->psqtEg = snap.psqtEg;
+    board->phase = snap.phase;
+    board->accIndex = snap.accIndex;
 }
 
 bool IsCheck(Board* board, bool color, int square)
@@ -365,17 +868,15 @@ bool IsCheck(Board* board, bool color, int square)
         kingSquare = index;
     }
 
-    uint64_t kingMoves = GetKingMoves(board, kingSquare, color);
-    uint64_t rookMoves = GetRookMoves(board, kingSquare, color);
-    uint64_t bishopMoves = GetBishopMoves(board, kingSquare, color);
-    uint64_t knightMoves = GetKnightMoves(board, kingSquare, color);
-    uint64_t pawnMoves = GetPawnMoves(board, kingSquare, color, true);
+    // Look from the king square with each piece type for an enemy piece of that type
+    uint64_t occupancy = GetOccupancy(board, 0) | GetOccupancy(board, 1);
+    uint64_t pawnAttacks = color == 0 ? pawn_white_capture_moves[kingSquare] : pawn_black_capture_moves[kingSquare];
 
-    if (rookMoves & (board->pieces[!color][3] | board->pieces[!color][4])) return true;
-    if (bishopMoves & (board->pieces[!color][2] | board->pieces[!color][4])) return true;
-    if (knightMoves & board->pieces[!color][1]) return true;
-    if (pawnMoves & board->pieces[!color][0]) return true;
-    if (kingMoves & board->pieces[!color][5]) return true;
+    if (knight_moves[kingSquare] & board->pieces[!color][1]) return true;
+    if (pawnAttacks & board->pieces[!color][0]) return true;
+    if (king_moves[kingSquare] & board->pieces[!color][5]) return true;
+    if (RookAttacksInline(kingSquare, occupancy) & (board->pieces[!color][3] | board->pieces[!color][4])) return true;
+    if (BishopAttacksInline(kingSquare, occupancy) & (board->pieces[!color][2] | board->pieces[!color][4])) return true;
 
     return false;
 }
@@ -450,19 +951,60 @@ void LoadFEN(Board* board, const std::string& fen)
         int rank = enPassant[1] - '1';
         board->en_passant = (1ULL << (rank * 8 + file));
     }
+
+    // The move counters are optional in some FENs
+    int halfmove = 0;
+    int fullmove = 1;
+    if (iss >> halfmove)
+        iss >> fullmove;
+    board->halfmove = halfmove;
+    board->fullmove = fullmove;
+
+    ComputePSQT(board, board->psqtMg, board->psqtEg, board->phase);
+    board->key = ComputeKey(board);
+    board->pawnKey = ComputePawnKey(board);
+    board->materialKey = ComputeMaterialKey(board);
+    board->gamePly = 0;
+    board->history[0] = board->key;
+    board->accIndex = 0;
+    if (nnueEnabled)
+        RefreshAccumulator(board);
 }
 
-// Converts a move to a string in algebraic coordinate notation (e.g. e2e4)
+// Converts a move to a string in algebraic coordinate notation (e.g. e2e4, e7e8q)
 std::string MoveToString(Move move)
 {
+    if (move.from == -1)
+        return "0000"; // null move, e.g. no legal moves at the root
+
     std::string result;
     result.push_back('a' + (move.from % 8));
     result.push_back('1' + (move.from / 8));
     result.push_back('a' + (move.to % 8));
     result.push_back('1' + (move.to / 8));
+    if (move.special >= 4 && move.special <= 7)
+        result.push_back("qnrb"[move.special - 4]);
     return result;
 }
 
+Move StringToMove(Board* board, const std::string& str)
+{
+    std::vector<Move> moves = GetMovesSide(board, board->turn);
+    for (const Move& move : moves)
+    {
+        if (MoveToString(move) != str)
+            continue;
+
+        Snapshot snap = MakeSnapshot(board);
+        MakeMove(board, move);
+        bool legal = IsMoveLegal(board, move);
+        UnmakeMove(board, snap);
+        if (legal)
+            return move;
+    }
+    return { -1, -1, -1, 0, 0, -1 };
+}
+
 bool IsMoveLegal(Board* board, Move move)
 {
     // For castling, check that none of the squares the king travels through are attacked.
@@ -480,20 +1022,31 @@ bool IsMoveLegal(Board* board, Move move)
     }
 }
 
+bool IsMoveLegal(Board* board, Move move, const AttackInfo& ai)
+{
+    // Not in check and neither the king, a pinned piece nor an en passant capture moved:
+    // the move can't leave the king attacked
+    if (!ai.checkers && move.pieceType != 5 && move.special != 2 && !(ai.pinned & (1ULL << move.from)))
+        return true;
+    return IsMoveLegal(board, move);
+}
+
 uint64_t Perft(Board* board, int depth, bool initial)
 {
     if (depth == 0)
         return 1;
 
     uint64_t nodes = 0;
-    std::vector<Move> moves = GetMovesSide(board, board->turn);
+    AttackInfo ai;
+    ComputeAttackInfo(board, ai);
+    std::vector<Move> moves = GetMovesSide(board, board->turn, ai);
 
     for (const Move& move : moves)
     {
         Snapshot snap = MakeSnapshot(board);
         MakeMove(board, move);
 
-        if (!IsMoveLegal(board, move))
+        if (!IsMoveLegal(board, move, ai))
         {
             UnmakeMove(board, snap);
             continue;
@@ -509,47 +1062,409 @@ uint64_t Perft(Board* board, int depth, bool initial)
     return nodes;
 }
 
-int EvaluatePos(Board* board)
+// A subtree of a parallel perft: a root move and a reply, played on a copy of the root board
+struct PerftTask
 {
-	//count material, this is a simple evaluation function
-	int pieceValues[6] = { 100, 320, 330, 500, 900, 20000 }; // Pawn, Knight, Bishop, Rook, Queen, King
-	int score = 0;
-	for (int i = 0; i < 6; ++i)
-	{
-		score += __popcnt64(board->pieces[0][i]) * pieceValues[i];
-		score -= __popcnt64(board->pieces[1][i]) * pieceValues[i];
-	}
+    const Snapshot* root;
+    Move moves[2];
+    int depth; // below the two moves
+    uint64_t nodes;
+};
+
+// Each thread plays its perft tasks on a board of its own, set up from the root position only
+static thread_local std::unique_ptr<Board> perftBoard;
+
+static void RunPerftTask(void* data)
+{
+    PerftTask* work = (PerftTask*)data;
+    if (!perftBoard)
+        perftBoard.reset(new Board());
+    Board* board = perftBoard.get();
+
+    // Nothing below the root looks at the root's history or accumulators, both start over
+    UnmakeMove(board, *work->root);
+    board->gamePly = 0;
+    board->history[0] = board->key;
+    board->accIndex = 0;
+    board->accumulators[0].computed[0] = board->accumulators[0].computed[1] = false;
+
+    MakeMove(board, work->moves[0]);
+    MakeMove(board, work->moves[1]);
+    work->nodes = Perft(board, work->depth, false);
+}
+
+uint64_t PerftParallel(Board* board, int depth)
+{
+    // Shallow trees cost less than handing them out to the pool
+    if (depth < 4 || PoolThreads() < 2)
+        return Perft(board, depth, true);
+
+    // Split two plies deep, the hundreds of subtrees keep the threads balanced
+    Snapshot root = MakeSnapshot(board);
+    std::vector<Move> rootMoves;
+    std::vector<size_t> firstWork;
+    std::vector<PerftTask> work;
+    AttackInfo ai;
+    ComputeAttackInfo(board, ai);
+    for (const Move& move : GetMovesSide(board, board->turn, ai))
+    {
+        Snapshot snap = MakeSnapshot(board);
+        MakeMove(board, move);
+        if (IsMoveLegal(board, move, ai))
+        {
+            rootMoves.push_back(move);
+            firstWork.push_back(work.size());
+            AttackInfo replyAi;
+            ComputeAttackInfo(board, replyAi);
+            for (const Move& reply : GetMovesSide(board, board->turn, replyAi))
+            {
+                Snapshot replySnap = MakeSnapshot(board);
+                MakeMove(board, reply);
+                if (IsMoveLegal(board, reply, replyAi))
+                    work.push_back({ &root, { move, reply }, depth - 2, 0 });
+                UnmakeMove(board, replySnap);
+            }
+        }
+        UnmakeMove(board, snap);
+    }
+    firstWork.push_back(work.size());
+
+    TaskGroup group;
+    std::vector<Task> tasks(work.size());
+    for (size_t i = 0; i < work.size(); ++i)
+    {
+        tasks[i] = { RunPerftTask, &work[i], &group };
+        Spawn(&tasks[i]);
+    }
+    Wait(&group);
+
+    uint64_t nodes = 0;
+    for (size_t i = 0; i < rootMoves.size(); ++i)
+    {
+        uint64_t moveNodes = 0;
+        for (size_t j = firstWork[i]; j < firstWork[i + 1]; ++j)
+            moveNodes += work[j].nodes;
+        std::cout << MoveToString(rootMoves[i]) << " " << moveNodes << "\n";
+        nodes += moveNodes;
+    }
+    return nodes;
+}
+
+uint64_t EvalCheck(Board* board, int depth)
+{
+    int mg, eg, phase;
+    ComputePSQT(board, mg, eg, phase);
+    uint64_t mismatches = (mg != board->psqtMg || eg != board->psqtEg || phase != board->phase
+        || board->pawnKey != ComputePawnKey(board) || board->materialKey != ComputeMaterialKey(board)
+        || board->history[board->gamePly] != board->key) ? 1 : 0;
+    if (nnueEnabled)
+        mismatches += CheckNNUE(board);
+
+    if (depth == 0)
+        return mismatches;
+
+    std::vector<Move> moves = GetMovesSide(board, board->turn);
+    for (const Move& move : moves)
+    {
+        Snapshot snap = MakeSnapshot(board);
+        MakeMove(board, move);
+        if (IsMoveLegal(board, move))
+            mismatches += EvalCheck(board, depth - 1);
+        UnmakeMove(board, snap);
+    }
+    return mismatches;
+}
+
+// Measured margin for lazy evaluation, not a bound: king danger alone reaches 500 and mobility,
+// threats and a pawn cache miss come on top. With go lazybench 6 over eight test positions a
+// third of the evaluations were lazy and the search ran about 10% faster. The full score was
+// at most 437 away from the lazy one and no lazy exit was on the wrong side of the window.
+// Measure again when the terms change.
+constexpr int LAZY_MARGIN = 400;
+
+int EvaluatePos(Board* board, int alpha, int beta)
+{
+    searchStats.evals++;
+
+    int cached;
+    if (ProbeEvalCache(board->key, cached))
+        return cached;
 
-    score = score * (board->turn ? -1 : 1);
+    // Material and piece-square scores are kept up to date by MakeMove, so this is
+    // just the blend between middlegame and endgame by the remaining material
+    const MaterialEntry* material = ProbeMaterial(board);
 
+    // Known endgames have their own evaluation
+    if (material->evaluate)
+    {
+        int score = material->evaluate(board, material->strongSide);
+        return board->turn ? -score : score;
+    }
+
+    // A loaded network replaces the hand-written terms
+    if (nnueEnabled)
+    {
+        int score = EvaluateNNUE(board);
+        StoreEvalCache(board->key, score);
+        return score;
+    }
+
+    int mg = board->psqtMg + material->imbalanceMg;
+    int eg = board->psqtEg + material->imbalanceEg;
+    int scale = material->scale ? material->scale(board) : SCALE_NORMAL;
+    int phase = material->phase;
+    int sign = board->turn ? -1 : 1;
+
+    // Pawn structure is cheap when it is cached, so only a miss is left for later
+    const PawnEntry* pawns = PeekPawns(board);
+    if (pawns)
+    {
+        mg += pawns->mg;
+        eg += pawns->eg;
+    }
+
+    // Lazy evaluation: stop if the remaining terms are unlikely to bring the score back into the window
+    if (evalTerms.lazy)
+    {
+        int score = sign * (mg * phase + eg * scale / SCALE_NORMAL * (MAX_PHASE - phase)) / MAX_PHASE;
+        if (score - LAZY_MARGIN >= beta || score + LAZY_MARGIN <= alpha)
+        {
+            searchStats.lazyEvals++;
+            if (evalTerms.checkLazy)
+            {
+                // The full score is cached, so a check changes the search a little
+                int full = EvaluatePos(board, -SCORE_INFINITE, SCORE_INFINITE);
+                if (score >= beta ? full < beta : full > alpha)
+                    searchStats.lazyWrong++;
+                searchStats.lazyMaxError = std::max(searchStats.lazyMaxError, std::abs(full - score));
+            }
+            return score;
+        }
+    }
+
+    if (!pawns)
+    {
+        pawns = ProbePawns(board);
+        mg += pawns->mg;
+        eg += pawns->eg;
+    }
+
+    if (evalTerms.mobility || evalTerms.kingSafety || evalTerms.threats)
+    {
+        AttackInfo ai;
+        ComputeAttackInfo(board, ai);
+        EvaluatePieces(board, ai, mg, eg);
+    }
+
+    eg = eg * scale / SCALE_NORMAL;
+    int score = sign * (mg * phase + eg * (MAX_PHASE - phase)) / MAX_PHASE;
+
+    // Only complete evaluations are cached, lazy ones depend on the window
+    StoreEvalCache(board->key, score);
     return score;
 }
 
-int Search(Board* board, int depth, int alpha, int beta)
+// Starts loading what the child node will look up first while the move is checked for
+// legality: its hash slot if it searches, its cached evaluation if it is a leaf
+inline void PrefetchChild(Board* board, int childDepth)
 {
-	if (depth == 0)
-	{
-        return EvaluatePos(board);
-	}
+    if (childDepth > 0)
+    {
+        TTPrefetch(board->key);
+    }
+    else
+    {
+        PrefetchEvalCache(board->key);
+        PrefetchPawns(board->pawnKey);
+    }
+}
+
+// Singular extensions are only tried this deep, the verification search is too costly below
+constexpr int SINGULAR_MIN_DEPTH = 6;
+
+static const Move noMove = { -1, -1, -1, 0, 0, -1 };
+
+// Depth of the current iteration, used to bound how far extensions can push the search
+static thread_local int rootDepth = 0;
+
+// Set once thread 0 finishes an iteration, helper threads then drop what they are doing.
+// A stopped search returns 0 without storing anything.
+static std::atomic<bool> searchStopped(false);
+
+// Simplified ABDADA: a move another thread is already searching is put off until the node's
+// other moves are done, by then its result is usually in the hash table. Moves being searched
+// are marked in a small table keyed by the position and the move. Only the first move of a
+// node is never put off, it has to establish a bound.
+static std::atomic<bool> abdada(false);
+constexpr int BUSY_TABLE_SIZE = 1 << 15;
+constexpr int ABDADA_MIN_DEPTH = 3; // shallower subtrees are cheaper to search twice
+static std::atomic<uint32_t> busyTable[BUSY_TABLE_SIZE];
+
+inline uint64_t MoveKey(uint64_t key, uint16_t code)
+{
+    return key ^ (code * 0x9E3779B97F4A7C15ULL);
+}
+
+inline bool IsBusy(uint64_t moveKey)
+{
+    return busyTable[moveKey & (BUSY_TABLE_SIZE - 1)].load(std::memory_order_relaxed) == (uint32_t)(moveKey >> 32);
+}
+
+inline void SetBusy(uint64_t moveKey)
+{
+    busyTable[moveKey & (BUSY_TABLE_SIZE - 1)].store((uint32_t)(moveKey >> 32), std::memory_order_relaxed);
+}
+
+inline void ClearBusy(uint64_t moveKey)
+{
+    uint32_t expected = (uint32_t)(moveKey >> 32);
+    busyTable[moveKey & (BUSY_TABLE_SIZE - 1)].compare_exchange_strong(expected, 0, std::memory_order_relaxed);
+}
+
+int Search(Board* board, int depth, int alpha, int beta, SearchStack* ss)
+{
+    if (searchStopped.load(std::memory_order_relaxed))
+        return 0;
+    searchStats.nodes++;
+
+    if (IsDraw(board, ss->ply))
+        return 0;
+
+    if (depth <= 0 || ss->ply >= MAX_PLY - 1)
+    {
+        return EvaluatePos(board, alpha, beta);
+    }
+
+    // If we are losing and can force a repetition, the score is at least a draw
+    if (alpha < 0 && HasGameCycle(board, ss->ply))
+    {
+        alpha = 0;
+        if (alpha >= beta)
+            return alpha;
+    }
+
+    // Mate distance pruning: even mating on the next move can't beat a shorter mate
+    // already found closer to the root, and the same holds for being mated
+    alpha = std::max(alpha, -SCORE_MATE + ss->ply);
+    beta = std::min(beta, SCORE_MATE - ss->ply - 1);
+    if (alpha >= beta)
+        return alpha;
+
+    (ss + 1)->ply = ss->ply + 1;
+    (ss + 1)->excludedMove = noMove;
 
-    int bestScore = -1000000;
+    // The exclusion search looks at the same position without one move, so its
+    // result must neither come from nor go to the table
+    bool excluded = ss->excludedMove.pieceType != -1;
+    uint16_t excludedCode = EncodeMove(ss->excludedMove);
 
-	std::vector<Move> moves = GetMovesSide(board, board->turn);
+    TTEntry tte;
+    bool ttHit = !excluded && TTProbe(board->key, tte);
+    uint16_t ttMove = ttHit ? tte.move : 0;
+    int ttScore = ttHit ? ScoreFromTT(tte.score, ss->ply) : 0;
 
-	for (const Move& move : moves)
+    if (ttHit && tte.depth >= depth)
+    {
+        if (tte.flag == TT_EXACT
+            || (tte.flag == TT_LOWER && ttScore >= beta)
+            || (tte.flag == TT_UPPER && ttScore <= alpha))
+            return ttScore;
+    }
+
+    int alphaOrig = alpha;
+    int bestScore = -SCORE_INFINITE;
+    int legalMoves = 0;
+    Move bestMove = noMove;
+
+    AttackInfo ai;
+    ComputeAttackInfo(board, ai);
+	std::vector<Move> moves = GetMovesSide(board, board->turn, ai);
+
+    // Search the hash move first
+    if (ttMove)
+    {
+        for (size_t i = 0; i < moves.size(); ++i)
+        {
+            if (EncodeMove(moves[i]) == ttMove)
+            {
+                std::swap(moves[0], moves[i]);
+                break;
+            }
+        }
+    }
+
+    // Moves put off by ABDADA are appended and searched after the others
+    size_t firstPass = moves.size();
+    bool deferring = abdada.load(std::memory_order_relaxed) && depth >= ABDADA_MIN_DEPTH;
+
+	for (size_t i = 0; i < moves.size(); ++i)
 	{
+        Move move = moves[i];
+        uint16_t code = EncodeMove(move);
+        if (excluded && code == excludedCode)
+            continue;
+
+        uint64_t moveKey = MoveKey(board->key, code);
+        if (deferring && i < firstPass && legalMoves > 0 && IsBusy(moveKey))
+        {
+            moves.push_back(move);
+            continue;
+        }
+
+        int extension = 0;
+        bool canExtend = ss->ply < 2 * rootDepth;
+
+        // Singular extension: if every other move fails low against a margin below
+        // the hash score, the hash move is the only good one and gets an extra ply.
+        // If instead the margin is still above beta, several moves beat beta and we
+        // can cut the node right away (multi-cut).
+        if (code == ttMove
+            && canExtend
+            && !excluded
+            && depth >= SINGULAR_MIN_DEPTH
+            && tte.flag != TT_UPPER
+            && tte.depth >= depth - 3
+            && abs(ttScore) < SCORE_MATE_IN_MAX_PLY)
+        {
+            int singularBeta = ttScore - 2 * depth;
+            ss->excludedMove = move;
+            int score = Search(board, (depth - 1) / 2, singularBeta - 1, singularBeta, ss);
+            ss->excludedMove = noMove;
+            if (searchStopped.load(std::memory_order_relaxed))
+                return 0;
+
+            if (score < singularBeta)
+                extension = 1;
+            else if (singularBeta >= beta)
+                return singularBeta;
+        }
+
 		Snapshot snap = MakeSnapshot(board);
 		MakeMove(board, move);
-		if (!IsMoveLegal(board, move))
+        PrefetchChild(board, depth - 1);
+		if (!IsMoveLegal(board, move, ai))
 		{
 			UnmakeMove(board, snap);
 			continue;
 		}
-		int score = -Search(board, depth - 1, -beta, -alpha);
+        legalMoves++;
+
+        // Check extension
+        if (canExtend && IsCheck(board, board->turn))
+            extension = 1;
+
+        if (deferring)
+            SetBusy(moveKey);
+		int score = -Search(board, depth - 1 + extension, -beta, -alpha, ss + 1);
+        if (deferring)
+            ClearBusy(moveKey);
         UnmakeMove(board, snap);
+        if (searchStopped.load(std::memory_order_relaxed))
+            return 0;
         if (score > bestScore)
         {
 			bestScore = score;
+            bestMove = move;
             if (score > alpha)
             {
                 alpha = score;
@@ -557,34 +1472,255 @@ int Search(Board* board, int depth, int alpha, int beta)
         }
         if (alpha >= beta)
         {
-            return bestScore;
+            break;
         }
 	}
 
+    // No legal moves: checkmate or stalemate. In the exclusion search the
+    // excluded move may still be legal, so just fail low there.
+    if (legalMoves == 0)
+    {
+        if (excluded)
+            return alpha;
+        bestScore = ai.checkers ? -SCORE_MATE + ss->ply : 0;
+    }
+
+    if (!excluded)
+    {
+        int flag = bestScore >= beta ? TT_LOWER : (bestScore > alphaOrig ? TT_EXACT : TT_UPPER);
+        TTStore(board->key, depth, ScoreToTT(bestScore, ss->ply), flag, EncodeMove(bestMove));
+    }
+
     return bestScore;
 }
 
-MoveScore SearchRoot(Board* board, int depth)
+std::vector<RootMove> GenerateRootMoves(Board* board, const std::vector<Move>& searchMoves)
 {
-	int bestScore = -1000000;
-	Move bestMove = { -1, -1, -1, 0, 0, -1 };
-	std::vector<Move> moves = GetMovesSide(board, board->turn);
-	for (const Move& move : moves)
-	{
-		Snapshot snap = MakeSnapshot(board);
-		MakeMove(board, move);
-		if (!IsMoveLegal(board, move))
-		{
-			UnmakeMove(board, snap);
-			continue;
-		}
-		int score = -Search(board, depth - 1, -1000000, 1000000);
-		if (score > bestScore)
-		{
-            bestMove = move;
-			bestScore = score;
-		}
-		UnmakeMove(board, snap);
-	}
-	return { bestMove, bestScore };
-}
\ No newline at end of file
+    std::vector<RootMove> rootMoves;
+    for (const Move& move : GetMovesSide(board, board->turn))
+    {
+        uint16_t code = EncodeMove(move);
+        if (!searchMoves.empty() && std::none_of(searchMoves.begin(), searchMoves.end(),
+                                                 [code](const Move& m) { return EncodeMove(m) == code; }))
+            continue;
+
+        Snapshot snap = MakeSnapshot(board);
+        MakeMove(board, move);
+        if (IsMoveLegal(board, move))
+            rootMoves.push_back({ move, -SCORE_INFINITE, -SCORE_INFINITE, 0, {} });
+        UnmakeMove(board, snap);
+    }
+
+    // Start with the hash move, the table may hold an earlier search of this position
+    TTEntry tte;
+    if (TTProbe(board->key, tte) && tte.move)
+    {
+        for (size_t i = 0; i < rootMoves.size(); ++i)
+        {
+            if (EncodeMove(rootMoves[i].move) == tte.move)
+            {
+                std::rotate(rootMoves.begin(), rootMoves.begin() + i, rootMoves.begin() + i + 1);
+                break;
+            }
+        }
+    }
+    return rootMoves;
+}
+
+// Follows the hash moves from the position after the first move, as long as they are legal
+// and don't repeat a position
+static std::vector<Move> ExtractPV(Board* board, const Move& first, int maxLength)
+{
+    std::vector<Move> pv = { first };
+    std::vector<Snapshot> played = { MakeSnapshot(board) };
+    MakeMove(board, first);
+
+    TTEntry tte;
+    while ((int)pv.size() < maxLength && !IsDraw(board, (int)pv.size()) && TTProbe(board->key, tte) && tte.move)
+    {
+        Move next = noMove;
+        for (const Move& move : GetMovesSide(board, board->turn))
+        {
+            if (EncodeMove(move) == tte.move)
+            {
+                next = move;
+                break;
+            }
+        }
+        if (next.pieceType == -1)
+            break;
+
+        Snapshot snap = MakeSnapshot(board);
+        MakeMove(board, next);
+        if (!IsMoveLegal(board, next))
+        {
+            UnmakeMove(board, snap);
+            break;
+        }
+        played.push_back(snap);
+        pv.push_back(next);
+    }
+
+    for (auto it = played.rbegin(); it != played.rend(); ++it)
+        UnmakeMove(board, *it);
+    return pv;
+}
+
+void SearchRoot(Board* board, int depth, std::vector<RootMove>& rootMoves, int multiPV)
+{
+    // The search pushes up to MAX_PLY accumulators and history keys above the root, the entries
+    // below it belong to moves the caller will unmake and must be left alone. Without room for a
+    // whole search it runs on a copy whose stacks start over at the root.
+    if ((nnueEnabled && board->accIndex + MAX_PLY >= NNUE_STACK_SIZE) || board->gamePly + MAX_PLY >= MAX_GAME_PLY)
+    {
+        std::unique_ptr<Board> rebased(new Board(*board));
+        if (nnueEnabled)
+            RebaseAccumulator(rebased.get());
+        RebaseHistory(rebased.get());
+        SearchRoot(rebased.get(), depth, rootMoves, multiPV);
+        return;
+    }
+
+    rootDepth = depth;
+    SearchStack stack[MAX_PLY + 2];
+    stack[0].ply = 0;
+    stack[0].excludedMove = noMove;
+    stack[1].ply = 1;
+    stack[1].excludedMove = noMove;
+
+    bool deferring = abdada.load(std::memory_order_relaxed) && depth >= ABDADA_MIN_DEPTH;
+    size_t lines = std::min((size_t)std::max(multiPV, 1), rootMoves.size());
+    for (RootMove& rootMove : rootMoves)
+    {
+        rootMove.previousScore = rootMove.score;
+        rootMove.nodes = 0;
+    }
+
+    // Each line searches the moves not reported yet, the best of them becomes the line
+    for (size_t line = 0; line < lines; ++line)
+    {
+        int alpha = -SCORE_INFINITE;
+
+        // Indices of the moves to search, moves put off by ABDADA are appended
+        std::vector<size_t> order;
+        for (size_t i = line; i < rootMoves.size(); ++i)
+            order.push_back(i);
+        size_t firstPass = order.size();
+
+        for (size_t k = 0; k < order.size(); ++k)
+        {
+            RootMove& rootMove = rootMoves[order[k]];
+            uint64_t moveKey = MoveKey(board->key, EncodeMove(rootMove.move));
+            if (deferring && k < firstPass && alpha > -SCORE_INFINITE && IsBusy(moveKey))
+            {
+                order.push_back(order[k]);
+                continue;
+            }
+
+            Snapshot snap = MakeSnapshot(board);
+            MakeMove(board, rootMove.move);
+            PrefetchChild(board, depth - 1);
+            int extension = IsCheck(board, board->turn) ? 1 : 0;
+            if (deferring)
+                SetBusy(moveKey);
+            uint64_t nodesBefore = searchStats.nodes;
+            int score = -Search(board, depth - 1 + extension, -SCORE_INFINITE, -alpha, stack + 1);
+            rootMove.nodes += searchStats.nodes - nodesBefore;
+            if (deferring)
+                ClearBusy(moveKey);
+            UnmakeMove(board, snap);
+            if (searchStopped.load(std::memory_order_relaxed))
+                return;
+
+            // Beta is infinite, so a score above alpha is exact. Moves that fail low sort behind it.
+            if (score > alpha)
+            {
+                alpha = score;
+                rootMove.score = score;
+            }
+            else
+            {
+                rootMove.score = -SCORE_INFINITE;
+            }
+        }
+
+        std::stable_sort(rootMoves.begin() + line, rootMoves.end(), [](const RootMove& a, const RootMove& b) {
+            if (a.score != b.score)
+                return a.score > b.score;
+            if (a.previousScore != b.previousScore)
+                return a.previousScore > b.previousScore;
+            return a.nodes > b.nodes;
+        });
+        rootMoves[line].pv = ExtractPV(board, rootMoves[line].move, std::min(2 * depth, MAX_PLY));
+    }
+
+    TTStore(board->key, depth, rootMoves[0].score, TT_EXACT, EncodeMove(rootMoves[0].move));
+}
+
+// A helper thread's search, on its own copy of the root position
+struct HelperSearch
+{
+    std::unique_ptr<Board> board;
+    std::vector<RootMove> rootMoves;
+    int depth;
+    int multiPV;
+    uint64_t nodes;
+};
+
+static void RunHelperSearch(void* data)
+{
+    HelperSearch* helper = (HelperSearch*)data;
+
+    // Thread 0 may end up running a helper it didn't get to hand out, keep its counters apart
+    SearchStats saved = searchStats;
+    searchStats = SearchStats();
+    SearchRoot(helper->board.get(), helper->depth, helper->rootMoves, helper->multiPV);
+    helper->nodes = searchStats.nodes;
+    searchStats = saved;
+}
+
+void SearchRootParallel(Board* board, int depth, std::vector<RootMove>& rootMoves, int multiPV, ParallelMode mode)
+{
+    int helpers = PoolThreads() - 1;
+    if (helpers <= 0)
+    {
+        SearchRoot(board, depth, rootMoves, multiPV);
+        return;
+    }
+
+    searchStopped = false;
+    abdada = mode == PARALLEL_ABDADA;
+
+    // Lazy SMP sends every other helper one ply deeper, so the threads diverge
+    // instead of repeating each other's work
+    TaskGroup group;
+    std::vector<HelperSearch> searches(helpers);
+    std::vector<Task> tasks(helpers);
+    for (int i = 0; i < helpers; ++i)
+    {
+        searches[i].board.reset(new Board(*board));
+        searches[i].rootMoves = rootMoves;
+        searches[i].depth = mode == PARALLEL_LAZY_SMP ? depth + (i & 1) : depth;
+        searches[i].multiPV = multiPV;
+        searches[i].nodes = 0;
+        tasks[i] = { RunHelperSearch, &searches[i], &group };
+        Spawn(&tasks[i]);
+    }
+
+    SearchRoot(board, depth, rootMoves, multiPV);
+    searchStopped = true;
+    Wait(&group);
+    searchStopped = false;
+    abdada = false;
+
+    for (const HelperSearch& helper : searches)
+        searchStats.nodes += helper.nodes;
+}
+
+int BestMoveEffort(const std::vector<RootMove>& rootMoves)
+{
+    uint64_t total = 0;
+    for (const RootMove& rootMove : rootMoves)
+        total += rootMove.nodes;
+    return total ? (int)(rootMoves[0].nodes * 1000 / total) : 0;
+}
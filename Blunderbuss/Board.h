@@ -5,6 +5,11 @@
 #include <cstdint> // For uint64_t
 #include <vector>
 #include <string>
+#include "NNUE.h"
+
+constexpr int MAX_GAME_PLY = 2048; // capacity of the position history
+
+constexpr const char* START_FEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
 
 struct Board
 {
@@ -12,6 +17,18 @@ struct Board
 	uint64_t en_passant; // En passant target square;
 	bool castling[4]; // 0 - white king side, 1 - white queen side, 2 - black king side, 3 - black queen side
     bool turn; // 0 - white, 1 - black
+    uint64_t key; // Zobrist hash of the position, updated incrementally by MakeMove
+    uint64_t pawnKey; // Zobrist hash of the pawns only, keys the pawn structure cache
+    uint64_t materialKey; // hash of the piece counts, keys the material cache
+    int halfmove; // plies since the last capture or pawn move, for the fifty-move rule
+    int fullmove; // starts at 1, incremented after black moves
+    int gamePly; // index of the current position in history
+    uint64_t history[MAX_GAME_PLY]; // keys of all positions since LoadFEN, history[gamePly] == key
+    int psqtMg; // material + piece-square score from white's point of view, middlegame
+    int psqtEg; // same for the endgame
+    int phase; // MAX_PHASE with all pieces on the board, 0 with only pawns and kings
+    int accIndex; // top of the accumulator stack, the current position's accumulator
+    Accumulator accumulators[NNUE_STACK_SIZE]; // kept up to date only while a network is loaded
 };
 
 struct Snapshot
@@ -20,6 +37,16 @@ struct Snapshot
     uint64_t en_passant;
     bool castling[4];
     bool turn;
+    uint64_t key;
+    uint64_t pawnKey;
+    uint64_t materialKey;
+    int halfmove;
+    int fullmove;
+    int gamePly;
+    int psqtMg;
+    int psqtEg;
+    int phase;
+    int accIndex;
 };
 
 struct Move
@@ -38,9 +65,84 @@ struct MoveScore
     int score;
 };
 
+constexpr int MAX_PLY = 128;
+
+// Scores are in centipawns. Mate scores are SCORE_MATE minus the distance in plies from
+// the root, so any score beyond SCORE_MATE_IN_MAX_PLY is a forced mate.
+constexpr int SCORE_INFINITE = 32001;
+constexpr int SCORE_MATE = 32000;
+constexpr int SCORE_MATE_IN_MAX_PLY = SCORE_MATE - MAX_PLY;
+
+// Per-ply search state, indexed by distance from the root
+struct SearchStack
+{
+    int ply;
+    Move excludedMove; // move skipped by the singular extension search, pieceType -1 if none
+};
+
+// Attack maps of a position, computed once per node by ComputeAttackInfo and shared
+// by move generation, legality checks and evaluation
+struct AttackInfo
+{
+    uint64_t occupancy;
+    uint64_t colorOccupancy[2];
+    uint64_t byPiece[2][6]; // squares attacked by each piece type of each color
+    uint64_t all[2]; // squares attacked by each color
+    uint64_t doubled[2]; // squares attacked at least twice by each color
+    uint64_t kingZone[2]; // king square and its neighbours
+    uint64_t pieceAttacks[64]; // attacks of the piece on each square (captures only for pawns)
+    uint64_t checkers; // enemy pieces giving check to the side to move
+    uint64_t pinned; // pieces of the side to move pinned to their king
+};
+
+// Counters collected while searching, one set per thread
+struct SearchStats
+{
+    uint64_t nodes;
+    uint64_t pawnProbes;
+    uint64_t pawnHits;
+    uint64_t evals;
+    uint64_t lazyEvals; // evaluations that stopped after the cheap terms
+    uint64_t lazyWrong; // lazy exits the full score would not have cut off on the same side, when checked
+    int lazyMaxError; // largest difference between a lazy and the full score, when checked
+    uint64_t evalCacheProbes;
+    uint64_t evalCacheHits;
+};
+
+extern thread_local SearchStats searchStats;
+
 // Function to initialize the board
 Board* InitBoard();
 
+// Fill the Zobrist key tables, safe to call more than once
+void InitZobrist();
+
+uint64_t ComputeKey(Board* board);
+
+uint64_t ComputePawnKey(Board* board);
+
+uint64_t ComputeMaterialKey(Board* board);
+
+// Fill the cuckoo tables used by HasGameCycle, safe to call more than once
+void InitCuckoo();
+
+// Move the slider attack tables to large pages if the OS grants them, safe to call more than once
+void InitAttackTables();
+
+bool AttackTablesLargePages();
+
+// True if the position is drawn by the fifty-move rule or repeats an earlier one.
+// ply is the distance from the root: repeating a position inside the search tree is
+// enough, positions before the root must have occurred twice.
+bool IsDraw(Board* board, int ply);
+
+// True if the side to move has a reversible move that repeats a position inside the search tree
+bool HasGameCycle(Board* board, int ply);
+
+// Moves the positions since the last irreversible move to the start of the history when a long
+// line of moves needs the room. Earlier positions are lost, nothing may unmake past this point.
+void RebaseHistory(Board* board);
+
 Snapshot MakeSnapshot(Board* board);
 
 // Function to print the board
@@ -58,28 +160,92 @@ uint64_t GetKingMoves(Board* board, int square, bool color);
 
 uint64_t GetPawnMoves(Board* board, int square, bool color, bool onlyCaptures);
 
+uint64_t RookAttacks(int square, uint64_t occupancy);
+
+uint64_t BishopAttacks(int square, uint64_t occupancy);
+
+void ComputeAttackInfo(Board* board, AttackInfo& ai);
+
 std::vector<Move> GetMovesSide(Board* board, bool color);
 
+// Generates pseudo-legal moves from precomputed attack maps
+std::vector<Move> GetMovesSide(Board* board, bool color, const AttackInfo& ai);
+
 void MakeMove(Board* board, Move move);
 
 void UnmakeMove(Board* board, Snapshot snap);
 
 uint64_t Perft(Board* board, int depthm, bool initial);
 
+// Perft on the thread pool, printing the count of every root move like Perft with initial set
+uint64_t PerftParallel(Board* board, int depth);
+
+// Computes the piece-square scores and game phase from scratch
+void ComputePSQT(Board* board, int& mg, int& eg, int& phase);
+
+// Walks the tree like Perft and compares the incrementally updated piece-square
+// scores, pawn key, material key and history top with a from-scratch computation at every node.
+// Returns the number of mismatching nodes.
+uint64_t EvalCheck(Board* board, int depth);
+
 void LoadFEN(Board* board, const std::string& fen);
 
 bool IsMoveLegal(Board* board, Move move);
 
+// Same as above, but uses the attack maps of the position before the move to
+// skip the check test for moves that cannot expose the king
+bool IsMoveLegal(Board* board, Move move, const AttackInfo& ai);
+
 bool IsCheck(Board* board, bool color, int square = -1);
 
 int PieceTypeFromLetter(char c);
 
 std::string MoveToString(Move move);
 
-int EvaluatePos(Board* board); 
+// Finds the legal move written in UCI long algebraic notation (e.g. e2e4, e7e8q).
+// Returns a move with pieceType -1 if there is none.
+Move StringToMove(Board* board, const std::string& str);
+
+// Static evaluation from the side to move's point of view. With a window, the expensive
+// terms are skipped when the cheap ones already put the score far outside it.
+int EvaluatePos(Board* board, int alpha = -SCORE_INFINITE, int beta = SCORE_INFINITE);
+
+int Search(Board* board, int depth, int alpha, int beta, SearchStack* ss);
+
+// A legal move at the root and what its searches found, kept from one iteration to the next
+struct RootMove
+{
+    Move move;
+    int score; // exact for reported lines, -SCORE_INFINITE for moves that failed low
+    int previousScore; // score in the previous iteration
+    uint64_t nodes; // size of the move's subtree in the last iteration
+    std::vector<Move> pv; // from the hash table, starting with move, for reported lines
+};
+
+// Legal moves of the position, the hash move first. If searchMoves isn't empty, only
+// the moves in it.
+std::vector<RootMove> GenerateRootMoves(Board* board, const std::vector<Move>& searchMoves = {});
+
+// Searches the root moves to depth and sorts them best first. With multiPV lines, the
+// first line is the best move, every next line the best of the moves not reported yet.
+// Moves below the lines are ordered by their previous score, then by the effort their
+// subtrees took, which is where refutations were hardest to find.
+void SearchRoot(Board* board, int depth, std::vector<RootMove>& rootMoves, int multiPV = 1);
+
+// How the threads of the pool share a search
+enum ParallelMode
+{
+    PARALLEL_LAZY_SMP, // every thread searches the whole tree, they meet through the hash table
+    PARALLEL_ABDADA    // threads put off moves that another thread is searching
+};
 
-int Search(Board* board, int depth, int alpha, int beta);
+// SearchRoot on every thread of the pool, each thread on its own copy of the board and root
+// moves, all of them sharing the hash table. Thread 0's results are kept, the other threads
+// stop when it is done. Nodes of all threads are counted.
+void SearchRootParallel(Board* board, int depth, std::vector<RootMove>& rootMoves, int multiPV, ParallelMode mode);
 
-MoveScore SearchRoot(Board* board, int depth);
+// Per mille of the last iteration's root nodes spent on the best move. A best move that
+// took most of the effort is unlikely to change, a time manager can stop early on it.
+int BestMoveEffort(const std::vector<RootMove>& rootMoves);
 
 #endif // BOARD_H
\ No newline at end of file
@@ -0,0 +1,127 @@
+#include "Endgame.h"
+#include <intrin.h>
+#include <algorithm>
+#include <cstdlib>
+
+constexpr int rookValueEg = 512;
+constexpr int queenValueEg = 936;
+
+inline int LsbSquare(uint64_t bb)
+{
+    unsigned long index;
+    _BitScanForward64(&index, bb);
+    return index;
+}
+
+inline int Distance(int a, int b)
+{
+    return std::max(abs(a % 8 - b % 8), abs(a / 8 - b / 8));
+}
+
+// Larger the closer the square is to the edge of the board, 0 to 6
+inline int PushToEdge(int square)
+{
+    int file = square % 8;
+    int rank = square / 8;
+    int fileDist = std::min(file, 7 - file);
+    int rankDist = std::min(rank, 7 - rank);
+    return 6 - fileDist - rankDist;
+}
+
+// Larger the closer the two squares are, 0 to 6
+inline int PushClose(int a, int b)
+{
+    return 7 - Distance(a, b);
+}
+
+inline int FromStrongSide(int score, int strongSide)
+{
+    return strongSide == 0 ? score : -score;
+}
+
+int EvaluateDraw(Board*, int)
+{
+    return 0;
+}
+
+// Mate with bishop and knight: the defending king must be driven to a corner of the bishop's color
+int EvaluateKBNK(Board* board, int strongSide)
+{
+    int strongKing = LsbSquare(board->pieces[strongSide][5]);
+    int weakKing = LsbSquare(board->pieces[!strongSide][5]);
+    int bishop = LsbSquare(board->pieces[strongSide][2]);
+
+    // a1 and h8 are dark squares; for a light-squared bishop mirror the board horizontally
+    bool darkBishop = ((bishop % 8) + (bishop / 8)) % 2 == 0;
+    int corner = darkBishop ? weakKing : (weakKing ^ 7);
+    int cornerDistance = std::min(Distance(corner, 0), Distance(corner, 63));
+
+    int score = SCORE_KNOWN_WIN + 60 * (7 - cornerDistance) + 20 * PushClose(strongKing, weakKing);
+    return FromStrongSide(score, strongSide);
+}
+
+// Rook against pawn: a win unless the pawn is far advanced and supported by its king
+int EvaluateKRKP(Board* board, int strongSide)
+{
+    int weakSide = !strongSide;
+    int strongKing = LsbSquare(board->pieces[strongSide][5]);
+    int weakKing = LsbSquare(board->pieces[weakSide][5]);
+    int rook = LsbSquare(board->pieces[strongSide][3]);
+    int pawn = LsbSquare(board->pieces[weakSide][0]);
+
+    int forward = weakSide == 0 ? 8 : -8;
+    int queeningSquare = weakSide == 0 ? 56 + pawn % 8 : pawn % 8;
+    int pawnRank = weakSide == 0 ? pawn / 8 : 7 - pawn / 8; // relative to the pawn's owner
+    bool weakToMove = board->turn == weakSide;
+
+    // The strong king is in front of the pawn
+    bool kingInFront = strongKing % 8 == pawn % 8
+        && (weakSide == 0 ? strongKing > pawn : strongKing < pawn);
+
+    int score;
+    if (kingInFront)
+    {
+        score = rookValueEg - Distance(strongKing, pawn);
+    }
+    // The weak king is too far from both the pawn and the rook
+    else if (Distance(weakKing, pawn) >= 3 + (weakToMove ? 1 : 0) && Distance(weakKing, rook) >= 3)
+    {
+        score = rookValueEg - Distance(strongKing, pawn);
+    }
+    // The pawn is far advanced, supported by its king and the strong king is far away
+    else if (pawnRank >= 5 && Distance(weakKing, pawn) == 1
+        && Distance(strongKing, pawn) >= 3 + (weakToMove ? 0 : 1))
+    {
+        score = 80 - 8 * Distance(strongKing, pawn);
+    }
+    else
+    {
+        int stop = pawn + forward;
+        score = 200 - 8 * (Distance(strongKing, stop) - Distance(weakKing, stop) - Distance(pawn, queeningSquare));
+    }
+    return FromStrongSide(score, strongSide);
+}
+
+// Queen against rook: a win by driving the defending king to the edge
+int EvaluateKQKR(Board* board, int strongSide)
+{
+    int strongKing = LsbSquare(board->pieces[strongSide][5]);
+    int weakKing = LsbSquare(board->pieces[!strongSide][5]);
+
+    int score = queenValueEg - rookValueEg + 30 * PushToEdge(weakKing) + 15 * PushClose(strongKing, weakKing);
+    return FromStrongSide(score, strongSide);
+}
+
+// With only bishops of opposite colors and pawns left, extra pawns are often not enough to win
+int ScaleOppositeBishops(Board* board)
+{
+    int whiteBishop = LsbSquare(board->pieces[0][2]);
+    int blackBishop = LsbSquare(board->pieces[1][2]);
+    bool whiteDark = ((whiteBishop % 8) + (whiteBishop / 8)) % 2 == 0;
+    bool blackDark = ((blackBishop % 8) + (blackBishop / 8)) % 2 == 0;
+    if (whiteDark == blackDark)
+        return SCALE_NORMAL;
+
+    int pawnDifference = abs((int)__popcnt64(board->pieces[0][0]) - (int)__popcnt64(board->pieces[1][0]));
+    return pawnDifference <= 1 ? SCALE_NORMAL / 4 : SCALE_NORMAL / 2;
+}
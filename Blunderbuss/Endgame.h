@@ -0,0 +1,26 @@
+#pragma once
+#ifndef ENDGAME_H
+#define ENDGAME_H
+
+#include "Board.h"
+
+// Score for a won endgame that the specialised evaluators build on, well below mate scores
+constexpr int SCORE_KNOWN_WIN = 10000;
+
+// Evaluates a known endgame, strongSide is the side with the extra material.
+// Returns the score from white's point of view.
+typedef int (*EndgameEval)(Board* board, int strongSide);
+
+// Returns a factor out of SCALE_NORMAL applied to the endgame score
+typedef int (*EndgameScale)(Board* board);
+
+constexpr int SCALE_NORMAL = 64;
+
+int EvaluateDraw(Board* board, int strongSide);
+int EvaluateKBNK(Board* board, int strongSide);
+int EvaluateKRKP(Board* board, int strongSide);
+int EvaluateKQKR(Board* board, int strongSide);
+
+int ScaleOppositeBishops(Board* board);
+
+#endif // ENDGAME_H
@@ -0,0 +1,66 @@
+#include "EvalCache.h"
+#include "Board.h"
+#include <vector>
+#include <atomic>
+#include <intrin.h>
+
+constexpr uint64_t SCORE_MASK = 0xFFFF;
+
+static std::atomic<size_t> cacheEntries(1 << 17);
+static std::atomic<uint32_t> cacheGeneration(0);
+
+static thread_local std::vector<uint64_t> cache;
+static thread_local uint32_t threadGeneration = ~0u;
+
+// Brings the calling thread's table in line with the last resize or clear
+static inline void SyncCache()
+{
+    uint32_t generation = cacheGeneration.load(std::memory_order_relaxed);
+    if (threadGeneration != generation)
+    {
+        cache.assign(cacheEntries.load(std::memory_order_relaxed), 0);
+        threadGeneration = generation;
+    }
+}
+
+void ResizeEvalCache(size_t megabytes)
+{
+    // Round the entry count down to a power of two so the index is a mask
+    size_t count = 1;
+    while (count * 2 * sizeof(uint64_t) <= megabytes * 1024 * 1024)
+        count *= 2;
+
+    cacheEntries = count;
+    cacheGeneration++;
+}
+
+void ClearEvalCache()
+{
+    cacheGeneration++;
+}
+
+void PrefetchEvalCache(uint64_t key)
+{
+    if (!cache.empty())
+        _mm_prefetch((const char*)&cache[key & (cache.size() - 1)], _MM_HINT_T0);
+}
+
+bool ProbeEvalCache(uint64_t key, int& score)
+{
+    SyncCache();
+    searchStats.evalCacheProbes++;
+
+    uint64_t entry = cache[key & (cache.size() - 1)];
+    if (entry == 0 || ((entry ^ key) & ~SCORE_MASK) != 0)
+        return false;
+
+    searchStats.evalCacheHits++;
+    score = (int16_t)(entry & SCORE_MASK);
+    return true;
+}
+
+void StoreEvalCache(uint64_t key, int score)
+{
+    SyncCache();
+    cache[key & (cache.size() - 1)] = (key & ~SCORE_MASK) | (uint16_t)(int16_t)score;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#ifndef EVALCACHE_H
+#define EVALCACHE_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Per-thread direct-mapped cache of static evaluations keyed by the position key.
+// Each entry packs the upper 48 bits of the key with a 16-bit score.
+
+// Sets the size of every thread's cache in megabytes and clears them
+void ResizeEvalCache(size_t megabytes);
+
+// Clears every thread's cache, each thread drops its entries on its next probe
+void ClearEvalCache();
+
+void PrefetchEvalCache(uint64_t key);
+
+bool ProbeEvalCache(uint64_t key, int& score);
+
+void StoreEvalCache(uint64_t key, int score);
+
+#endif // EVALCACHE_H
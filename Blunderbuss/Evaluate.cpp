@@ -0,0 +1,115 @@
+#include "Evaluate.h"
+#include <intrin.h>
+#include <algorithm>
+
+EvalTerms evalTerms;
+
+// Mobility bonus by the number of safe squares, for knight, bishop, rook and queen
+constexpr int mobilityMg[4][28] = {
+    { -30, -20, -8, 0, 6, 12, 18, 22, 25 },
+    { -25, -12, 0, 8, 15, 21, 26, 30, 34, 37, 40, 42, 44, 46 },
+    { -20, -12, -6, 0, 4, 8, 12, 15, 18, 21, 23, 25, 27, 28, 29 },
+    { -15, -10, -6, -3, 0, 2, 4, 6, 8, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 20, 21, 21, 22, 22, 23, 23, 24 }
+};
+constexpr int mobilityEg[4][28] = {
+    { -40, -25, -12, 0, 8, 14, 19, 23, 26 },
+    { -45, -25, -10, 2, 12, 20, 27, 33, 38, 42, 45, 48, 50, 52 },
+    { -50, -25, -8, 5, 15, 24, 32, 39, 45, 50, 54, 58, 61, 63, 65 },
+    { -40, -28, -18, -10, -3, 3, 8, 13, 17, 21, 25, 28, 31, 34, 36, 38, 40, 42, 44, 45, 46, 47, 48, 49, 50, 51, 52, 53 }
+};
+
+// Weight of a king zone attack by the attacking piece type
+constexpr int kingAttackWeight[6] = { 0, 2, 2, 3, 5, 0 };
+
+// Middlegame penalty by accumulated attack units on the king zone
+constexpr int kingDanger[100] = {
+      0,   0,   1,   2,   3,   5,   7,   9,  12,  15,
+     18,  22,  26,  30,  35,  39,  44,  50,  56,  62,
+     68,  75,  82,  85,  89,  97, 105, 113, 122, 131,
+    140, 150, 169, 180, 191, 202, 213, 225, 237, 248,
+    260, 272, 283, 295, 307, 319, 330, 342, 354, 366,
+    377, 389, 401, 412, 424, 436, 448, 459, 471, 483,
+    494, 500, 500, 500, 500, 500, 500, 500, 500, 500,
+    500, 500, 500, 500, 500, 500, 500, 500, 500, 500,
+    500, 500, 500, 500, 500, 500, 500, 500, 500, 500,
+    500, 500, 500, 500, 500, 500, 500, 500, 500, 500
+};
+
+constexpr int hangingMg = -30, hangingEg = -20; // per undefended attacked piece
+constexpr int pawnThreatMg = -45, pawnThreatEg = -35; // per piece attacked by an enemy pawn
+
+inline int Popcount(uint64_t bb)
+{
+    return (int)__popcnt64(bb);
+}
+
+inline int PopSquare(uint64_t& bb)
+{
+    unsigned long index;
+    _BitScanForward64(&index, bb);
+    bb &= bb - 1;
+    return index;
+}
+
+// Terms for one color, positive is good for that color
+static void EvaluateSide(Board* board, const AttackInfo& ai, int us, int& mg, int& eg)
+{
+    int them = !us;
+    uint64_t ownPieces = ai.colorOccupancy[us] & ~board->pieces[us][0] & ~board->pieces[us][5];
+
+    if (evalTerms.mobility)
+    {
+        // Squares not occupied by own pieces and not attacked by enemy pawns
+        uint64_t safe = ~ai.colorOccupancy[us] & ~ai.byPiece[them][0];
+        for (int pieceType = 1; pieceType <= 4; ++pieceType)
+        {
+            uint64_t pieces = board->pieces[us][pieceType];
+            while (pieces)
+            {
+                int count = Popcount(ai.pieceAttacks[PopSquare(pieces)] & safe);
+                mg += mobilityMg[pieceType - 1][count];
+                eg += mobilityEg[pieceType - 1][count];
+            }
+        }
+    }
+
+    if (evalTerms.kingSafety)
+    {
+        // Sum weighted enemy attacks on our king zone, only dangerous with two or more attackers
+        uint64_t zone = ai.kingZone[us];
+        int attackers = 0;
+        int units = 0;
+        for (int pieceType = 1; pieceType <= 4; ++pieceType)
+        {
+            uint64_t pieces = board->pieces[them][pieceType];
+            while (pieces)
+            {
+                int hits = Popcount(ai.pieceAttacks[PopSquare(pieces)] & zone);
+                attackers += hits ? 1 : 0;
+                units += kingAttackWeight[pieceType] * hits;
+            }
+        }
+        // Zone squares the enemy attacks twice and we don't defend
+        units += Popcount(zone & ai.doubled[them] & ~ai.all[us]);
+
+        if (attackers >= 2)
+            mg -= kingDanger[std::min(units, 99)];
+    }
+
+    if (evalTerms.threats)
+    {
+        int hanging = Popcount(ownPieces & ai.all[them] & ~ai.all[us]);
+        int pawnThreats = Popcount(ownPieces & ai.byPiece[them][0]);
+        mg += hangingMg * hanging + pawnThreatMg * pawnThreats;
+        eg += hangingEg * hanging + pawnThreatEg * pawnThreats;
+    }
+}
+
+void EvaluatePieces(Board* board, const AttackInfo& ai, int& mg, int& eg)
+{
+    int mgWhite = 0, egWhite = 0, mgBlack = 0, egBlack = 0;
+    EvaluateSide(board, ai, 0, mgWhite, egWhite);
+    EvaluateSide(board, ai, 1, mgBlack, egBlack);
+    mg += mgWhite - mgBlack;
+    eg += egWhite - egBlack;
+}
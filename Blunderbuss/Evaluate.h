@@ -0,0 +1,23 @@
+#pragma once
+#ifndef EVALUATE_H
+#define EVALUATE_H
+
+#include "Board.h"
+
+// Evaluation terms that can be switched off through UCI options to measure their cost
+struct EvalTerms
+{
+    bool mobility = true;
+    bool kingSafety = true;
+    bool threats = true;
+    bool lazy = true; // skip the terms above when the cheap score is far outside the window
+    bool checkLazy = false; // also compute the full score at every lazy exit, for go lazybench
+};
+
+extern EvalTerms evalTerms;
+
+// Adds the mobility, king safety and threat terms enabled in evalTerms to mg and eg,
+// from white's point of view
+void EvaluatePieces(Board* board, const AttackInfo& ai, int& mg, int& eg);
+
+#endif // EVALUATE_H
@@ -0,0 +1,139 @@
+#include "LargePages.h"
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/mman.h>
+#endif
+
+constexpr size_t LARGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+inline size_t RoundUp(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+#if defined(_WIN32)
+
+// Large pages need the "Lock pages in memory" privilege, which has to be enabled on the
+// process token even when the account holds it
+static bool EnableLockMemoryPrivilege()
+{
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+        return false;
+
+    TOKEN_PRIVILEGES privileges = {};
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    bool enabled = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid)
+        && AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr)
+        && GetLastError() == ERROR_SUCCESS;
+    CloseHandle(token);
+    return enabled;
+}
+
+// Allocations that got large pages, they are committed and locked when allocated
+static std::vector<const void*> largeAllocations;
+
+void* AllocateLarge(size_t size)
+{
+    size_t pageSize = GetLargePageMinimum();
+    if (pageSize && EnableLockMemoryPrivilege())
+    {
+        void* memory = VirtualAlloc(nullptr, RoundUp(size, pageSize),
+                                    MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (memory)
+        {
+            largeAllocations.push_back(memory);
+            return memory;
+        }
+    }
+    return AllocateSmall(size);
+}
+
+void* AllocateSmall(size_t size)
+{
+    return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+
+bool HasLargePages(const void* memory)
+{
+    return std::find(largeAllocations.begin(), largeAllocations.end(), memory) != largeAllocations.end();
+}
+
+void FreeLarge(void* memory)
+{
+    if (memory)
+    {
+        largeAllocations.erase(std::remove(largeAllocations.begin(), largeAllocations.end(), memory), largeAllocations.end());
+        VirtualFree(memory, 0, MEM_RELEASE);
+    }
+}
+
+#else
+
+// Transparent huge pages are only a hint, the kernel reports what it actually did in
+// the AnonHugePages line of the mapping in /proc/self/smaps
+bool HasLargePages(const void* memory)
+{
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    bool inMapping = false;
+    uintptr_t address = (uintptr_t)memory;
+    while (std::getline(smaps, line))
+    {
+        // Each mapping starts with a "start-end perms ..." line, followed by "Name: value" lines
+        uintptr_t start, end;
+        char dash;
+        std::istringstream range(line);
+        if (line.find('-') < line.find(' ') && range >> std::hex >> start >> dash >> end && dash == '-')
+        {
+            inMapping = address >= start && address < end;
+            continue;
+        }
+        if (inMapping && line.compare(0, 14, "AnonHugePages:") == 0)
+            return std::stoul(line.substr(14)) > 0;
+    }
+    return false;
+}
+
+void* AllocateLarge(size_t size)
+{
+    size_t rounded = RoundUp(size, LARGE_PAGE_SIZE);
+    void* memory = nullptr;
+    if (posix_memalign(&memory, LARGE_PAGE_SIZE, rounded) != 0)
+        return nullptr;
+
+    // Advise before the first touch, the kernel picks the page size when the memory faults in
+    madvise(memory, rounded, MADV_HUGEPAGE);
+    return memory;
+}
+
+void* AllocateSmall(size_t size)
+{
+    size_t rounded = RoundUp(size, LARGE_PAGE_SIZE);
+    void* memory = nullptr;
+    if (posix_memalign(&memory, LARGE_PAGE_SIZE, rounded) != 0)
+        return nullptr;
+#if defined(MADV_NOHUGEPAGE)
+    madvise(memory, rounded, MADV_NOHUGEPAGE);
+#endif
+    return memory;
+}
+
+void FreeLarge(void* memory)
+{
+    free(memory);
+}
+
+#endif
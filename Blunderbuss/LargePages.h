@@ -0,0 +1,21 @@
+#pragma once
+#ifndef LARGEPAGES_H
+#define LARGEPAGES_H
+
+#include <cstddef>
+
+// Allocates memory aligned to 2 MB and asks the OS to back it with large pages, so big tables
+// probed at random cost fewer TLB misses. The memory is usable either way. It is left untouched:
+// where the OS places pages on first touch, the threads that clear it decide its NUMA nodes.
+// Returns nullptr if the allocation fails.
+void* AllocateLarge(size_t size);
+
+// Whether memory from AllocateLarge got large pages, only known once it has been written
+bool HasLargePages(const void* memory);
+
+// Memory on ordinary pages, to compare against
+void* AllocateSmall(size_t size);
+
+void FreeLarge(void* memory);
+
+#endif // LARGEPAGES_H
@@ -0,0 +1,133 @@
+#include "Material.h"
+#include "PieceSquareTables.h"
+#include <intrin.h>
+#include <vector>
+#include <algorithm>
+
+constexpr int MATERIAL_TABLE_SIZE = 1 << 13; // entries, power of two
+
+static thread_local std::vector<MaterialEntry> materialTable;
+
+constexpr int bishopPairMg = 30, bishopPairEg = 50;
+constexpr int knightPerPawn = 6; // knights gain value with more pawns on the board
+constexpr int rookPerPawn = -12; // rooks lose value with more pawns on the board
+
+// Imbalance of one side, positive is good for that side
+static void Imbalance(const int own[6], int& mg, int& eg)
+{
+    mg = 0;
+    eg = 0;
+    if (own[2] >= 2)
+    {
+        mg += bishopPairMg;
+        eg += bishopPairEg;
+    }
+    int pawnAdjust = own[1] * knightPerPawn * (own[0] - 5) + own[3] * rookPerPawn * (own[0] - 5);
+    mg += pawnAdjust;
+    eg += pawnAdjust;
+}
+
+// Looks for an endgame with a specialised evaluator or scaling function
+static void DetectEndgame(const int count[2][6], MaterialEntry* entry)
+{
+    entry->evaluate = nullptr;
+    entry->scale = nullptr;
+    entry->strongSide = 0;
+
+    int minors[2], majors[2], total[2];
+    for (int c = 0; c < 2; ++c)
+    {
+        minors[c] = count[c][1] + count[c][2];
+        majors[c] = count[c][3] + count[c][4];
+        total[c] = count[c][0] + minors[c] + majors[c];
+    }
+
+    // Insufficient material: no pawns or major pieces and at most a minor piece
+    // each, or two knights against a bare king
+    if (count[0][0] + count[1][0] == 0 && majors[0] + majors[1] == 0)
+    {
+        bool lone = minors[0] <= 1 && minors[1] <= 1;
+        bool twoKnights = (count[0][1] == 2 && count[0][2] == 0 && minors[1] == 0)
+            || (count[1][1] == 2 && count[1][2] == 0 && minors[0] == 0);
+        if (lone || twoKnights)
+        {
+            entry->evaluate = EvaluateDraw;
+            return;
+        }
+    }
+
+    for (int strong = 0; strong < 2; ++strong)
+    {
+        int weak = !strong;
+
+        // KBNK
+        if (total[strong] == 2 && count[strong][1] == 1 && count[strong][2] == 1 && total[weak] == 0)
+        {
+            entry->evaluate = EvaluateKBNK;
+            entry->strongSide = strong;
+            return;
+        }
+
+        // KRKP
+        if (total[strong] == 1 && count[strong][3] == 1 && total[weak] == 1 && count[weak][0] == 1)
+        {
+            entry->evaluate = EvaluateKRKP;
+            entry->strongSide = strong;
+            return;
+        }
+
+        // KQKR
+        if (total[strong] == 1 && count[strong][4] == 1 && total[weak] == 1 && count[weak][3] == 1)
+        {
+            entry->evaluate = EvaluateKQKR;
+            entry->strongSide = strong;
+            return;
+        }
+    }
+
+    // Bishops and pawns only, with one bishop each; the colors are checked at evaluation time
+    if (count[0][2] == 1 && count[1][2] == 1
+        && count[0][1] + majors[0] + count[1][1] + majors[1] == 0)
+    {
+        entry->scale = ScaleOppositeBishops;
+    }
+}
+
+const MaterialEntry* ProbeMaterial(Board* board)
+{
+    if (materialTable.empty())
+        ClearMaterialTable();
+
+    MaterialEntry* entry = &materialTable[board->materialKey & (MATERIAL_TABLE_SIZE - 1)];
+    if (entry->key == board->materialKey && entry->phase >= 0)
+        return entry;
+
+    int count[2][6];
+    int phase = 0;
+    for (int c = 0; c < 2; ++c)
+    {
+        for (int p = 0; p < 6; ++p)
+        {
+            count[c][p] = (int)__popcnt64(board->pieces[c][p]);
+            phase += count[c][p] * phaseIncrement[p];
+        }
+    }
+
+    int mgWhite, egWhite, mgBlack, egBlack;
+    Imbalance(count[0], mgWhite, egWhite);
+    Imbalance(count[1], mgBlack, egBlack);
+
+    entry->key = board->materialKey;
+    entry->imbalanceMg = mgWhite - mgBlack;
+    entry->imbalanceEg = egWhite - egBlack;
+    entry->phase = std::min(phase, MAX_PHASE);
+    DetectEndgame(count, entry);
+    return entry;
+}
+
+void ClearMaterialTable()
+{
+    MaterialEntry empty = {};
+    empty.phase = -1; // marks the slot unused, key 0 is a valid material key
+    materialTable.assign(MATERIAL_TABLE_SIZE, empty);
+}
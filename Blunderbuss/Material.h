@@ -0,0 +1,28 @@
+#pragma once
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <cstdint>
+#include "Board.h"
+#include "Endgame.h"
+
+// Everything the evaluation needs that depends only on the piece counts
+struct MaterialEntry
+{
+    uint64_t key;
+    int imbalanceMg; // from white's point of view
+    int imbalanceEg;
+    int phase;
+    int strongSide; // side evaluate is called for
+    EndgameEval evaluate; // replaces the normal evaluation for a known endgame, nullptr if none
+    EndgameScale scale; // scales the endgame score, nullptr if none
+};
+
+// Returns the material information of the position, computed on a miss and
+// cached in a per-thread table keyed by board->materialKey
+const MaterialEntry* ProbeMaterial(Board* board);
+
+// Drops all cached entries of the calling thread's table
+void ClearMaterialTable();
+
+#endif // MATERIAL_H
@@ -0,0 +1,312 @@
+#include "NNUE.h"
+#include "Board.h"
+#include "NNUEKernels.h"
+#include <intrin.h>
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+
+// Network file layout, all values little endian:
+//   "BBNN", uint32 version, uint32 king buckets, features, L1, L2, L3
+//   int16 feature biases[L1], int16 feature weights[features][L1]
+//   int32 L2 biases[L2], int8 L2 weights[L2][2 * L1]
+//   int32 L3 biases[L3], int8 L3 weights[L3][L2]
+//   int32 output bias, int8 output weights[L3]
+constexpr uint32_t NNUE_VERSION = 1;
+
+struct Network
+{
+    std::vector<int16_t> featureBiases;
+    std::vector<int16_t> featureWeights; // one column of NNUE_L1 weights per feature
+    std::vector<int32_t> l2Biases;
+    std::vector<int8_t> l2Weights; // blocked for the sparse kernel
+    std::vector<int32_t> l3Biases;
+    std::vector<int8_t> l3Weights;
+    int32_t outputBias;
+    std::vector<int8_t> outputWeights;
+};
+
+static Network network;
+bool nnueEnabled = false;
+
+// Bumped on every load, each thread drops its refresh cache when it sees a new network
+static std::atomic<uint32_t> networkGeneration(0);
+
+// Picked once at startup from the CPU's features
+static const NNUEKernels* kernels = BestKernels();
+
+// Blocks the rows of a layer for the sparse kernel: weights of four consecutive inputs
+// for all outputs are stored together, [inputSize / 4][outputSize][4]
+static std::vector<int8_t> BlockWeights(const std::vector<int8_t>& rows, int inputSize, int outputSize)
+{
+    std::vector<int8_t> blocked(rows.size());
+    for (int o = 0; o < outputSize; ++o)
+        for (int i = 0; i < inputSize; ++i)
+            blocked[((i / 4) * outputSize + o) * 4 + i % 4] = rows[o * inputSize + i];
+    return blocked;
+}
+
+template <typename T>
+static bool ReadArray(std::ifstream& in, std::vector<T>& values, size_t count)
+{
+    values.resize(count);
+    in.read(reinterpret_cast<char*>(values.data()), count * sizeof(T));
+    return (bool)in;
+}
+
+bool LoadNetwork(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+
+    char magic[4];
+    uint32_t header[6];
+    in.read(magic, 4);
+    in.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!in || memcmp(magic, "BBNN", 4) != 0 || header[0] != NNUE_VERSION
+        || header[1] != NNUE_KING_BUCKETS || header[2] != NNUE_FEATURES
+        || header[3] != NNUE_L1 || header[4] != NNUE_L2 || header[5] != NNUE_L3)
+        return false;
+
+    Network loaded;
+    if (!ReadArray(in, loaded.featureBiases, NNUE_L1)
+        || !ReadArray(in, loaded.featureWeights, (size_t)NNUE_FEATURES * NNUE_L1)
+        || !ReadArray(in, loaded.l2Biases, NNUE_L2)
+        || !ReadArray(in, loaded.l2Weights, NNUE_L2 * 2 * NNUE_L1)
+        || !ReadArray(in, loaded.l3Biases, NNUE_L3)
+        || !ReadArray(in, loaded.l3Weights, NNUE_L3 * NNUE_L2))
+        return false;
+    in.read(reinterpret_cast<char*>(&loaded.outputBias), sizeof(int32_t));
+    if (!in || !ReadArray(in, loaded.outputWeights, NNUE_L3))
+        return false;
+
+    loaded.l2Weights = BlockWeights(loaded.l2Weights, 2 * NNUE_L1, NNUE_L2);
+    network = std::move(loaded);
+    networkGeneration++;
+    nnueEnabled = true;
+    return true;
+}
+
+inline int LowestSquare(uint64_t bb)
+{
+    unsigned long index;
+    _BitScanForward64(&index, bb);
+    return index;
+}
+
+// Buckets are 2x2 blocks of squares, seen from the perspective's side of the board
+inline int KingBucket(int perspective, int kingSquare)
+{
+    int square = perspective ? kingSquare ^ 56 : kingSquare;
+    return ((square >> 4) << 2) + ((square & 7) >> 1);
+}
+
+inline int FeatureIndex(int perspective, int kingSquare, int color, int piece, int square)
+{
+    int flip = perspective ? 56 : 0;
+    int pieceIndex = (color != perspective) * 6 + piece; // own pieces first
+    return ((KingBucket(perspective, kingSquare) * 12 + pieceIndex) << 6) + (square ^ flip);
+}
+
+static int Forward(const NNUEKernels& k, const Accumulator& acc, int stm)
+{
+    alignas(64) uint8_t transformed[2 * NNUE_L1];
+    alignas(64) int32_t l2Out[NNUE_L2];
+    alignas(64) uint8_t l2Clipped[NNUE_L2];
+    alignas(64) int32_t l3Out[NNUE_L3];
+    alignas(64) uint8_t l3Clipped[NNUE_L3];
+    int32_t output;
+
+    // Most of the first layer's inputs are clipped to zero, so it skips them
+    k.transform(acc.values[stm], acc.values[!stm], transformed);
+    k.affineSparse(transformed, 2 * NNUE_L1, network.l2Weights.data(), network.l2Biases.data(), l2Out, NNUE_L2);
+    k.clip(l2Out, l2Clipped, NNUE_L2);
+    k.affine(l2Clipped, NNUE_L2, network.l3Weights.data(), network.l3Biases.data(), l3Out, NNUE_L3);
+    k.clip(l3Out, l3Clipped, NNUE_L3);
+    k.affine(l3Clipped, NNUE_L3, network.outputWeights.data(), &network.outputBias, &output, 1);
+    return output / NNUE_OUTPUT_SCALE;
+}
+
+static void RefreshPerspective(const NNUEKernels& k, const Board* board, int perspective, int16_t* out)
+{
+    int features[32];
+    int count = 0;
+    int kingSquare = LowestSquare(board->pieces[perspective][5]);
+    for (int color = 0; color < 2; ++color)
+    {
+        for (int piece = 0; piece < 6; ++piece)
+        {
+            uint64_t bb = board->pieces[color][piece];
+            while (bb && count < 32)
+            {
+                features[count++] = FeatureIndex(perspective, kingSquare, color, piece, LowestSquare(bb));
+                bb &= bb - 1;
+            }
+        }
+    }
+    k.update(network.featureBiases.data(), out, network.featureWeights.data(), features, count, nullptr, 0);
+}
+
+// Refresh cache: per thread, the last accumulator built for each king bucket and perspective
+// with the pieces it was built from. A refresh starts from there and only applies the
+// pieces that differ, which after a king move is usually a handful instead of all of them.
+struct RefreshEntry
+{
+    int16_t values[NNUE_L1];
+    uint64_t pieces[2][6];
+};
+
+static thread_local std::vector<RefreshEntry> refreshTable;
+static thread_local uint32_t refreshGeneration = ~0u;
+
+static void RefreshFromCache(Board* board, int perspective, int16_t* out)
+{
+    uint32_t generation = networkGeneration.load(std::memory_order_relaxed);
+    if (refreshGeneration != generation)
+    {
+        // Every entry starts as the empty board, the biases alone
+        refreshTable.resize(NNUE_KING_BUCKETS * 2);
+        for (RefreshEntry& entry : refreshTable)
+        {
+            memcpy(entry.values, network.featureBiases.data(), sizeof(entry.values));
+            memset(entry.pieces, 0, sizeof(entry.pieces));
+        }
+        refreshGeneration = generation;
+    }
+
+    int kingSquare = LowestSquare(board->pieces[perspective][5]);
+    RefreshEntry& entry = refreshTable[KingBucket(perspective, kingSquare) * 2 + perspective];
+
+    int added[32], removed[32];
+    int addedCount = 0, removedCount = 0;
+    for (int color = 0; color < 2; ++color)
+    {
+        for (int piece = 0; piece < 6; ++piece)
+        {
+            uint64_t current = board->pieces[color][piece];
+            uint64_t cached = entry.pieces[color][piece];
+            for (uint64_t bb = cached & ~current; bb && removedCount < 32; bb &= bb - 1)
+                removed[removedCount++] = FeatureIndex(perspective, kingSquare, color, piece, LowestSquare(bb));
+            for (uint64_t bb = current & ~cached; bb && addedCount < 32; bb &= bb - 1)
+                added[addedCount++] = FeatureIndex(perspective, kingSquare, color, piece, LowestSquare(bb));
+            entry.pieces[color][piece] = current;
+        }
+    }
+
+    kernels->update(entry.values, entry.values, network.featureWeights.data(), added, addedCount, removed, removedCount);
+    memcpy(out, entry.values, sizeof(entry.values));
+}
+
+void RefreshAccumulator(Board* board)
+{
+    Accumulator& acc = board->accumulators[board->accIndex];
+    RefreshFromCache(board, 0, acc.values[0]);
+    RefreshFromCache(board, 1, acc.values[1]);
+    acc.computed[0] = acc.computed[1] = true;
+}
+
+// Brings one perspective of the top accumulator up to date. Walks down to the last computed
+// entry and applies the moves since then in order, leaving every entry on the way computed
+// for sibling nodes. If the perspective's king changed bucket on the way, only the top is
+// refreshed.
+static void UpdatePerspective(Board* board, int perspective)
+{
+    Accumulator* stack = board->accumulators;
+    int top = board->accIndex;
+    int kingSquare = LowestSquare(board->pieces[perspective][5]);
+
+    int start = top;
+    while (!stack[start].computed[perspective])
+    {
+        const DirtyPiece& dirty = stack[start].dirty;
+        if ((dirty.piece[0] == 5 && dirty.color[0] == perspective
+            && KingBucket(perspective, dirty.from[0]) != KingBucket(perspective, dirty.to[0])) || start == 0)
+        {
+            RefreshFromCache(board, perspective, stack[top].values[perspective]);
+            stack[top].computed[perspective] = true;
+            return;
+        }
+        start--;
+    }
+
+    for (int i = start + 1; i <= top; ++i)
+    {
+        const DirtyPiece& dirty = stack[i].dirty;
+        int added[3], removed[3];
+        int addedCount = 0, removedCount = 0;
+        for (int j = 0; j < dirty.count; ++j)
+        {
+            if (dirty.from[j] != -1)
+                removed[removedCount++] = FeatureIndex(perspective, kingSquare, dirty.color[j], dirty.piece[j], dirty.from[j]);
+            if (dirty.to[j] != -1)
+                added[addedCount++] = FeatureIndex(perspective, kingSquare, dirty.color[j], dirty.piece[j], dirty.to[j]);
+        }
+        kernels->update(stack[i - 1].values[perspective], stack[i].values[perspective], network.featureWeights.data(),
+                        added, addedCount, removed, removedCount);
+        stack[i].computed[perspective] = true;
+    }
+}
+
+static void UpdateAccumulator(Board* board)
+{
+    UpdatePerspective(board, 0);
+    UpdatePerspective(board, 1);
+}
+
+void PushAccumulator(Board* board, const DirtyPiece& dirty)
+{
+    Accumulator& next = board->accumulators[++board->accIndex];
+    next.dirty = dirty;
+    next.computed[0] = next.computed[1] = false;
+}
+
+int EvaluateNNUE(Board* board)
+{
+    UpdateAccumulator(board);
+    return Forward(*kernels, board->accumulators[board->accIndex], board->turn);
+}
+
+void RebaseAccumulator(Board* board)
+{
+    if (board->accIndex > 0)
+    {
+        // The bottom entry must be computed, the walk back stops there
+        UpdateAccumulator(board);
+        board->accumulators[0] = board->accumulators[board->accIndex];
+        board->accIndex = 0;
+    }
+}
+
+uint64_t CheckNNUE(Board* board)
+{
+    UpdateAccumulator(board);
+    const Accumulator& acc = board->accumulators[board->accIndex];
+    const NNUEKernels* sets[4];
+    int count = SupportedKernels(sets);
+    int expected = Forward(*sets[0], acc, board->turn);
+    uint64_t mismatches = 0;
+
+    // Every kernel set supported here must rebuild the incremental accumulator exactly
+    // and agree with the scalar forward pass
+    for (int s = 0; s < count; ++s)
+    {
+        Accumulator fresh;
+        for (int perspective = 0; perspective < 2; ++perspective)
+        {
+            RefreshPerspective(*sets[s], board, perspective, fresh.values[perspective]);
+            if (memcmp(acc.values[perspective], fresh.values[perspective], sizeof(fresh.values[perspective])) != 0)
+                mismatches++;
+        }
+        if (Forward(*sets[s], acc, board->turn) != expected)
+            mismatches++;
+    }
+    return mismatches;
+}
+
+const char* NNUEKernelName()
+{
+    return kernels->name;
+}
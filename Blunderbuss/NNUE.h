@@ -0,0 +1,70 @@
+#pragma once
+#ifndef NNUE_H
+#define NNUE_H
+
+#include <cstdint>
+#include <string>
+
+struct Board;
+
+// King-bucketed HalfKA network: every piece (kings included) is a feature, seen from both sides.
+// Each side's features are relative to its own king bucket, with the board flipped for black.
+constexpr int NNUE_KING_BUCKETS = 16;
+constexpr int NNUE_FEATURES = NNUE_KING_BUCKETS * 12 * 64;
+constexpr int NNUE_L1 = 256; // accumulator width per perspective
+constexpr int NNUE_L2 = 32;
+constexpr int NNUE_L3 = 32;
+
+constexpr int NNUE_WEIGHT_SHIFT = 6; // hidden layer outputs are scaled down by 2^6 before clipping
+constexpr int NNUE_OUTPUT_SCALE = 16; // network output units per centipawn
+
+// Pieces changed by one move, at most a moved piece, a captured one and the castling rook
+struct DirtyPiece
+{
+    int count;
+    int color[3];
+    int piece[3];
+    int from[3]; // -1 when the piece appears (promotion)
+    int to[3]; // -1 when the piece disappears (capture, promoted pawn)
+};
+
+// Accumulators live on a stack in the board, one entry per MakeMove, so unmaking is free.
+// MakeMove only records the move's dirty pieces, the values are computed when evaluated.
+constexpr int NNUE_STACK_SIZE = 160;
+
+struct alignas(64) Accumulator
+{
+    int16_t values[2][NNUE_L1]; // indexed by perspective
+    bool computed[2];
+    DirtyPiece dirty; // the move that led here from the entry below
+};
+
+// True once a network has been loaded, MakeMove records dirty pieces only then
+extern bool nnueEnabled;
+
+// Loads a network file, returns false and keeps the previous network on failure
+bool LoadNetwork(const std::string& path);
+
+// Rebuilds the accumulator at the top of the stack from scratch
+void RefreshAccumulator(Board* board);
+
+// Moves the accumulator at the top of the stack to the bottom when a long line of moves needs
+// the room. The entries below are lost, nothing may unmake past the top entry afterwards.
+// Must see the position the top entry belongs to.
+void RebaseAccumulator(Board* board);
+
+// Pushes an accumulator for the position after a move, to be computed on demand. The caller
+// makes room first, MakeMove rebases a full stack before it changes the board.
+void PushAccumulator(Board* board, const DirtyPiece& dirty);
+
+// Evaluation from the side to move's point of view, in centipawns
+int EvaluateNNUE(Board* board);
+
+// Counts differences between the incremental accumulator and a refresh, and between the
+// forward passes of the scalar and the vectorised kernels
+uint64_t CheckNNUE(Board* board);
+
+// Instruction set of the kernels in use
+const char* NNUEKernelName();
+
+#endif // NNUE_H
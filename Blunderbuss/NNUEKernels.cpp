@@ -0,0 +1,569 @@
+#include "NNUEKernels.h"
+#include "NNUE.h"
+#include <immintrin.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+// MSVC accepts any intrinsic in any function, GCC and Clang need the instruction set
+// enabled per function so the rest of the binary still runs on a baseline CPU
+#if defined(__GNUC__)
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#else
+#define TARGET_SSE41
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+constexpr int MAX_SPARSE_OUTPUTS = 64;
+
+// Indices of the four-byte input groups that are not all zero
+static int FindNonZero(const uint8_t* input, int inputSize, int* indices)
+{
+    int count = 0;
+    for (int i = 0; i < inputSize / 4; ++i)
+    {
+        uint32_t group;
+        memcpy(&group, input + i * 4, 4);
+        if (group)
+            indices[count++] = i;
+    }
+    return count;
+}
+
+// Scalar reference
+
+static void UpdateScalar(const int16_t* in, int16_t* out, const int16_t* weights,
+                         const int* added, int addedCount, const int* removed, int removedCount)
+{
+    for (int i = 0; i < NNUE_L1; ++i)
+    {
+        int value = in[i];
+        for (int j = 0; j < removedCount; ++j)
+            value -= weights[removed[j] * NNUE_L1 + i];
+        for (int j = 0; j < addedCount; ++j)
+            value += weights[added[j] * NNUE_L1 + i];
+        out[i] = (int16_t)value; // wraps like the 16-bit vector adds
+    }
+}
+
+static void TransformScalar(const int16_t* us, const int16_t* them, uint8_t* output)
+{
+    for (int i = 0; i < NNUE_L1; ++i)
+    {
+        output[i] = (uint8_t)std::clamp((int)us[i], 0, 127);
+        output[NNUE_L1 + i] = (uint8_t)std::clamp((int)them[i], 0, 127);
+    }
+}
+
+static void AffineScalar(const uint8_t* input, int inputSize, const int8_t* weights,
+                         const int32_t* biases, int32_t* output, int outputSize)
+{
+    for (int o = 0; o < outputSize; ++o)
+    {
+        int32_t sum = biases[o];
+        for (int i = 0; i < inputSize; ++i)
+            sum += weights[o * inputSize + i] * input[i];
+        output[o] = sum;
+    }
+}
+
+static void AffineSparseScalar(const uint8_t* input, int inputSize, const int8_t* weights,
+                               const int32_t* biases, int32_t* output, int outputSize)
+{
+    int indices[2 * NNUE_L1 / 4];
+    int count = FindNonZero(input, inputSize, indices);
+    for (int o = 0; o < outputSize; ++o)
+        output[o] = biases[o];
+    for (int j = 0; j < count; ++j)
+    {
+        const uint8_t* in = input + indices[j] * 4;
+        const int8_t* block = weights + indices[j] * outputSize * 4;
+        for (int o = 0; o < outputSize; ++o)
+            for (int k = 0; k < 4; ++k)
+                output[o] += block[o * 4 + k] * in[k];
+    }
+}
+
+static void ClipScalar(const int32_t* input, uint8_t* output, int size)
+{
+    for (int i = 0; i < size; ++i)
+        output[i] = (uint8_t)std::clamp(input[i] >> NNUE_WEIGHT_SHIFT, 0, 127);
+}
+
+// SSE4.1. Inputs to the int8 layers are at most 127, so the pairwise sums of maddubs
+// never saturate and every dot product is exact.
+
+TARGET_SSE41 static void UpdateSse41(const int16_t* in, int16_t* out, const int16_t* weights,
+                                     const int* added, int addedCount, const int* removed, int removedCount)
+{
+    constexpr int CHUNK = 64; // 8 registers
+    for (int chunk = 0; chunk < NNUE_L1; chunk += CHUNK)
+    {
+        __m128i acc[CHUNK / 8];
+        for (int k = 0; k < CHUNK / 8; ++k)
+            acc[k] = _mm_loadu_si128((const __m128i*)(in + chunk + k * 8));
+        for (int j = 0; j < removedCount; ++j)
+        {
+            const int16_t* column = weights + removed[j] * NNUE_L1 + chunk;
+            for (int k = 0; k < CHUNK / 8; ++k)
+                acc[k] = _mm_sub_epi16(acc[k], _mm_loadu_si128((const __m128i*)(column + k * 8)));
+        }
+        for (int j = 0; j < addedCount; ++j)
+        {
+            const int16_t* column = weights + added[j] * NNUE_L1 + chunk;
+            for (int k = 0; k < CHUNK / 8; ++k)
+                acc[k] = _mm_add_epi16(acc[k], _mm_loadu_si128((const __m128i*)(column + k * 8)));
+        }
+        for (int k = 0; k < CHUNK / 8; ++k)
+            _mm_storeu_si128((__m128i*)(out + chunk + k * 8), acc[k]);
+    }
+}
+
+TARGET_SSE41 static void TransformSse41(const int16_t* us, const int16_t* them, uint8_t* output)
+{
+    const __m128i max = _mm_set1_epi8(127);
+    for (int half = 0; half < 2; ++half)
+    {
+        const int16_t* values = half ? them : us;
+        for (int i = 0; i < NNUE_L1; i += 16)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i*)(values + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(values + i + 8));
+            _mm_storeu_si128((__m128i*)(output + half * NNUE_L1 + i), _mm_min_epu8(_mm_packus_epi16(a, b), max));
+        }
+    }
+}
+
+TARGET_SSE41 static inline int32_t HorizontalSumSse41(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0x4E));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0xB1));
+    return _mm_cvtsi128_si32(v);
+}
+
+TARGET_SSE41 static void AffineSse41(const uint8_t* input, int inputSize, const int8_t* weights,
+                                     const int32_t* biases, int32_t* output, int outputSize)
+{
+    const __m128i ones = _mm_set1_epi16(1);
+    for (int o = 0; o < outputSize; ++o)
+    {
+        __m128i sum = _mm_setzero_si128();
+        const int8_t* row = weights + o * inputSize;
+        for (int i = 0; i < inputSize; i += 16)
+        {
+            __m128i in = _mm_loadu_si128((const __m128i*)(input + i));
+            __m128i w = _mm_loadu_si128((const __m128i*)(row + i));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_maddubs_epi16(in, w), ones));
+        }
+        output[o] = biases[o] + HorizontalSumSse41(sum);
+    }
+}
+
+TARGET_SSE41 static void AffineSparseSse41(const uint8_t* input, int inputSize, const int8_t* weights,
+                                           const int32_t* biases, int32_t* output, int outputSize)
+{
+    const __m128i ones = _mm_set1_epi16(1);
+    int indices[2 * NNUE_L1 / 4];
+    int count = FindNonZero(input, inputSize, indices);
+    int registers = outputSize / 4;
+
+    __m128i acc[MAX_SPARSE_OUTPUTS / 4];
+    for (int r = 0; r < registers; ++r)
+        acc[r] = _mm_loadu_si128((const __m128i*)(biases + r * 4));
+    for (int j = 0; j < count; ++j)
+    {
+        int32_t group;
+        memcpy(&group, input + indices[j] * 4, 4);
+        __m128i in = _mm_set1_epi32(group);
+        const int8_t* block = weights + indices[j] * outputSize * 4;
+        for (int r = 0; r < registers; ++r)
+        {
+            __m128i w = _mm_loadu_si128((const __m128i*)(block + r * 16));
+            acc[r] = _mm_add_epi32(acc[r], _mm_madd_epi16(_mm_maddubs_epi16(in, w), ones));
+        }
+    }
+    for (int r = 0; r < registers; ++r)
+        _mm_storeu_si128((__m128i*)(output + r * 4), acc[r]);
+}
+
+TARGET_SSE41 static void ClipSse41(const int32_t* input, uint8_t* output, int size)
+{
+    const __m128i max = _mm_set1_epi8(127);
+    for (int i = 0; i < size; i += 16)
+    {
+        __m128i a = _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(input + i)), NNUE_WEIGHT_SHIFT);
+        __m128i b = _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(input + i + 4)), NNUE_WEIGHT_SHIFT);
+        __m128i c = _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(input + i + 8)), NNUE_WEIGHT_SHIFT);
+        __m128i d = _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(input + i + 12)), NNUE_WEIGHT_SHIFT);
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+        _mm_storeu_si128((__m128i*)(output + i), _mm_min_epu8(packed, max));
+    }
+}
+
+// AVX2. The pack instructions work within 128-bit lanes, so their results are permuted
+// back into order.
+
+TARGET_AVX2 static void UpdateAvx2(const int16_t* in, int16_t* out, const int16_t* weights,
+                                   const int* added, int addedCount, const int* removed, int removedCount)
+{
+    constexpr int CHUNK = 128; // 8 registers
+    for (int chunk = 0; chunk < NNUE_L1; chunk += CHUNK)
+    {
+        __m256i acc[CHUNK / 16];
+        for (int k = 0; k < CHUNK / 16; ++k)
+            acc[k] = _mm256_loadu_si256((const __m256i*)(in + chunk + k * 16));
+        for (int j = 0; j < removedCount; ++j)
+        {
+            const int16_t* column = weights + removed[j] * NNUE_L1 + chunk;
+            for (int k = 0; k < CHUNK / 16; ++k)
+                acc[k] = _mm256_sub_epi16(acc[k], _mm256_loadu_si256((const __m256i*)(column + k * 16)));
+        }
+        for (int j = 0; j < addedCount; ++j)
+        {
+            const int16_t* column = weights + added[j] * NNUE_L1 + chunk;
+            for (int k = 0; k < CHUNK / 16; ++k)
+                acc[k] = _mm256_add_epi16(acc[k], _mm256_loadu_si256((const __m256i*)(column + k * 16)));
+        }
+        for (int k = 0; k < CHUNK / 16; ++k)
+            _mm256_storeu_si256((__m256i*)(out + chunk + k * 16), acc[k]);
+    }
+}
+
+TARGET_AVX2 static void TransformAvx2(const int16_t* us, const int16_t* them, uint8_t* output)
+{
+    const __m256i max = _mm256_set1_epi8(127);
+    for (int half = 0; half < 2; ++half)
+    {
+        const int16_t* values = half ? them : us;
+        for (int i = 0; i < NNUE_L1; i += 32)
+        {
+            __m256i a = _mm256_loadu_si256((const __m256i*)(values + i));
+            __m256i b = _mm256_loadu_si256((const __m256i*)(values + i + 16));
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+            _mm256_storeu_si256((__m256i*)(output + half * NNUE_L1 + i), _mm256_min_epu8(packed, max));
+        }
+    }
+}
+
+TARGET_AVX2 static inline int32_t HorizontalSumAvx2(__m256i v)
+{
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    return _mm_cvtsi128_si32(sum);
+}
+
+TARGET_AVX2 static void AffineAvx2(const uint8_t* input, int inputSize, const int8_t* weights,
+                                   const int32_t* biases, int32_t* output, int outputSize)
+{
+    const __m256i ones = _mm256_set1_epi16(1);
+    for (int o = 0; o < outputSize; ++o)
+    {
+        __m256i sum = _mm256_setzero_si256();
+        const int8_t* row = weights + o * inputSize;
+        for (int i = 0; i < inputSize; i += 32)
+        {
+            __m256i in = _mm256_loadu_si256((const __m256i*)(input + i));
+            __m256i w = _mm256_loadu_si256((const __m256i*)(row + i));
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(in, w), ones));
+        }
+        output[o] = biases[o] + HorizontalSumAvx2(sum);
+    }
+}
+
+TARGET_AVX2 static void AffineSparseAvx2(const uint8_t* input, int inputSize, const int8_t* weights,
+                                         const int32_t* biases, int32_t* output, int outputSize)
+{
+    const __m256i ones = _mm256_set1_epi16(1);
+    int indices[2 * NNUE_L1 / 4];
+    int count = FindNonZero(input, inputSize, indices);
+    int registers = outputSize / 8;
+
+    __m256i acc[MAX_SPARSE_OUTPUTS / 8];
+    for (int r = 0; r < registers; ++r)
+        acc[r] = _mm256_loadu_si256((const __m256i*)(biases + r * 8));
+    for (int j = 0; j < count; ++j)
+    {
+        int32_t group;
+        memcpy(&group, input + indices[j] * 4, 4);
+        __m256i in = _mm256_set1_epi32(group);
+        const int8_t* block = weights + indices[j] * outputSize * 4;
+        for (int r = 0; r < registers; ++r)
+        {
+            __m256i w = _mm256_loadu_si256((const __m256i*)(block + r * 32));
+            acc[r] = _mm256_add_epi32(acc[r], _mm256_madd_epi16(_mm256_maddubs_epi16(in, w), ones));
+        }
+    }
+    for (int r = 0; r < registers; ++r)
+        _mm256_storeu_si256((__m256i*)(output + r * 8), acc[r]);
+}
+
+TARGET_AVX2 static void ClipAvx2(const int32_t* input, uint8_t* output, int size)
+{
+    const __m256i max = _mm256_set1_epi8(127);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    for (int i = 0; i < size; i += 32)
+    {
+        __m256i a = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i*)(input + i)), NNUE_WEIGHT_SHIFT);
+        __m256i b = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i*)(input + i + 8)), NNUE_WEIGHT_SHIFT);
+        __m256i c = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i*)(input + i + 16)), NNUE_WEIGHT_SHIFT);
+        __m256i d = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i*)(input + i + 24)), NNUE_WEIGHT_SHIFT);
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+        packed = _mm256_permutevar8x32_epi32(packed, order);
+        _mm256_storeu_si256((__m256i*)(output + i), _mm256_min_epu8(packed, max));
+    }
+}
+
+// AVX-512 (F and BW). Layers narrower than a register fall back to the AVX2 kernels,
+// which every AVX-512 CPU also has.
+
+TARGET_AVX512 static void UpdateAvx512(const int16_t* in, int16_t* out, const int16_t* weights,
+                                       const int* added, int addedCount, const int* removed, int removedCount)
+{
+    constexpr int CHUNK = 256; // 8 registers
+    for (int chunk = 0; chunk < NNUE_L1; chunk += CHUNK)
+    {
+        __m512i acc[CHUNK / 32];
+        for (int k = 0; k < CHUNK / 32; ++k)
+            acc[k] = _mm512_loadu_si512((const void*)(in + chunk + k * 32));
+        for (int j = 0; j < removedCount; ++j)
+        {
+            const int16_t* column = weights + removed[j] * NNUE_L1 + chunk;
+            for (int k = 0; k < CHUNK / 32; ++k)
+                acc[k] = _mm512_sub_epi16(acc[k], _mm512_loadu_si512((const void*)(column + k * 32)));
+        }
+        for (int j = 0; j < addedCount; ++j)
+        {
+            const int16_t* column = weights + added[j] * NNUE_L1 + chunk;
+            for (int k = 0; k < CHUNK / 32; ++k)
+                acc[k] = _mm512_add_epi16(acc[k], _mm512_loadu_si512((const void*)(column + k * 32)));
+        }
+        for (int k = 0; k < CHUNK / 32; ++k)
+            _mm512_storeu_si512((void*)(out + chunk + k * 32), acc[k]);
+    }
+}
+
+TARGET_AVX512 static void TransformAvx512(const int16_t* us, const int16_t* them, uint8_t* output)
+{
+    const __m512i max = _mm512_set1_epi8(127);
+    const __m512i order = _mm512_set_epi64(7, 5, 3, 1, 6, 4, 2, 0);
+    for (int half = 0; half < 2; ++half)
+    {
+        const int16_t* values = half ? them : us;
+        for (int i = 0; i < NNUE_L1; i += 64)
+        {
+            __m512i a = _mm512_loadu_si512((const void*)(values + i));
+            __m512i b = _mm512_loadu_si512((const void*)(values + i + 32));
+            __m512i packed = _mm512_permutexvar_epi64(order, _mm512_packus_epi16(a, b));
+            _mm512_storeu_si512((void*)(output + half * NNUE_L1 + i), _mm512_min_epu8(packed, max));
+        }
+    }
+}
+
+TARGET_AVX512 static void AffineAvx512(const uint8_t* input, int inputSize, const int8_t* weights,
+                                       const int32_t* biases, int32_t* output, int outputSize)
+{
+    if (inputSize % 64)
+    {
+        AffineAvx2(input, inputSize, weights, biases, output, outputSize);
+        return;
+    }
+
+    const __m512i ones = _mm512_set1_epi16(1);
+    for (int o = 0; o < outputSize; ++o)
+    {
+        __m512i sum = _mm512_setzero_si512();
+        const int8_t* row = weights + o * inputSize;
+        for (int i = 0; i < inputSize; i += 64)
+        {
+            __m512i in = _mm512_loadu_si512((const void*)(input + i));
+            __m512i w = _mm512_loadu_si512((const void*)(row + i));
+            sum = _mm512_add_epi32(sum, _mm512_madd_epi16(_mm512_maddubs_epi16(in, w), ones));
+        }
+        output[o] = biases[o] + _mm512_reduce_add_epi32(sum);
+    }
+}
+
+TARGET_AVX512 static void AffineSparseAvx512(const uint8_t* input, int inputSize, const int8_t* weights,
+                                             const int32_t* biases, int32_t* output, int outputSize)
+{
+    const __m512i ones = _mm512_set1_epi16(1);
+    int indices[2 * NNUE_L1 / 4];
+    int count = FindNonZero(input, inputSize, indices);
+    int registers = outputSize / 16;
+
+    __m512i acc[MAX_SPARSE_OUTPUTS / 16];
+    for (int r = 0; r < registers; ++r)
+        acc[r] = _mm512_loadu_si512((const void*)(biases + r * 16));
+    for (int j = 0; j < count; ++j)
+    {
+        int32_t group;
+        memcpy(&group, input + indices[j] * 4, 4);
+        __m512i in = _mm512_set1_epi32(group);
+        const int8_t* block = weights + indices[j] * outputSize * 4;
+        for (int r = 0; r < registers; ++r)
+        {
+            __m512i w = _mm512_loadu_si512((const void*)(block + r * 64));
+            acc[r] = _mm512_add_epi32(acc[r], _mm512_madd_epi16(_mm512_maddubs_epi16(in, w), ones));
+        }
+    }
+    for (int r = 0; r < registers; ++r)
+        _mm512_storeu_si512((void*)(output + r * 16), acc[r]);
+}
+
+static const NNUEKernels scalarKernels = { "scalar", UpdateScalar, TransformScalar, AffineScalar, AffineSparseScalar, ClipScalar };
+static const NNUEKernels sse41Kernels = { "sse4.1", UpdateSse41, TransformSse41, AffineSse41, AffineSparseSse41, ClipSse41 };
+static const NNUEKernels avx2Kernels = { "avx2", UpdateAvx2, TransformAvx2, AffineAvx2, AffineSparseAvx2, ClipAvx2 };
+static const NNUEKernels avx512Kernels = { "avx512", UpdateAvx512, TransformAvx512, AffineAvx512, AffineSparseAvx512, ClipAvx2 };
+
+static void Cpuid(int leaf, int subleaf, uint32_t regs[4])
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, leaf, subleaf);
+    for (int i = 0; i < 4; ++i)
+        regs[i] = (uint32_t)info[i];
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Register state the operating system saves on context switches
+static uint64_t EnabledXState()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+int SupportedKernels(const NNUEKernels** sets)
+{
+    int count = 0;
+    sets[count++] = &scalarKernels;
+
+    uint32_t regs[4];
+    Cpuid(0, 0, regs);
+    uint32_t maxLeaf = regs[0];
+
+    Cpuid(1, 0, regs);
+    bool ssse3 = regs[2] & (1u << 9);
+    bool sse41 = regs[2] & (1u << 19);
+    bool osxsave = regs[2] & (1u << 27);
+    bool avx = regs[2] & (1u << 28);
+    if (ssse3 && sse41)
+        sets[count++] = &sse41Kernels;
+
+    if (!osxsave || !avx || maxLeaf < 7)
+        return count;
+    uint64_t xstate = EnabledXState();
+    Cpuid(7, 0, regs);
+    bool avx2 = regs[1] & (1u << 5);
+    bool avx512f = regs[1] & (1u << 16);
+    bool avx512bw = regs[1] & (1u << 30);
+
+    if (avx2 && (xstate & 0x6) == 0x6)
+        sets[count++] = &avx2Kernels;
+    if (avx2 && avx512f && avx512bw && (xstate & 0xE6) == 0xE6)
+        sets[count++] = &avx512Kernels;
+    return count;
+}
+
+const NNUEKernels* BestKernels()
+{
+    const NNUEKernels* sets[4];
+    int count = SupportedKernels(sets);
+    return sets[count - 1];
+}
+
+template <typename F>
+static double NanosecondsPerCall(int iterations, F call)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+        call(i);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+void BenchmarkKernels(int iterations)
+{
+    // Random weights for a slice of the feature set, inputs about as sparse as a real position's
+    constexpr int FEATURES = 1024;
+    std::mt19937 rng(12345);
+    std::vector<int16_t> featureWeights(FEATURES * NNUE_L1);
+    std::vector<int16_t> accumulator(2 * NNUE_L1);
+    std::vector<int8_t> l2Weights(NNUE_L2 * 2 * NNUE_L1);
+    std::vector<int32_t> biases(NNUE_L2), hidden(NNUE_L2);
+    std::vector<uint8_t> transformed(2 * NNUE_L1), layerInput(2 * NNUE_L1), clipped(NNUE_L2);
+    for (int16_t& w : featureWeights) w = (int16_t)(rng() % 81) - 40;
+    for (int16_t& v : accumulator) v = (int16_t)(rng() % 400) - 200;
+    for (int8_t& w : l2Weights) w = (int8_t)(rng() % 256 - 128);
+    for (int32_t& b : biases) b = (int32_t)(rng() % 4000) - 2000;
+    // About 70% of the four-byte groups of a clipped accumulator are zero
+    for (int i = 0; i < 2 * NNUE_L1; i += 4)
+    {
+        bool zero = rng() % 10 < 7;
+        for (int j = 0; j < 4; ++j)
+            layerInput[i + j] = zero ? 0 : (uint8_t)(rng() % 128);
+    }
+
+    int added[2] = { 17, 300 }, removed[2] = { 511, 1000 };
+    int refresh[32];
+    for (int i = 0; i < 32; ++i)
+        refresh[i] = (int)(rng() % FEATURES);
+
+    const NNUEKernels* sets[4];
+    int count = SupportedKernels(sets);
+    uint64_t checksum = 0;
+    for (int s = 0; s < count; ++s)
+    {
+        const NNUEKernels& k = *sets[s];
+        int16_t* us = accumulator.data();
+        int16_t* them = accumulator.data() + NNUE_L1;
+
+        double update = NanosecondsPerCall(iterations, [&](int i) {
+            k.update(us, them, featureWeights.data(), added, 2, removed, 2);
+            checksum += them[i % NNUE_L1];
+        });
+        double refreshTime = NanosecondsPerCall(iterations, [&](int i) {
+            k.update(us, them, featureWeights.data(), refresh, 32, nullptr, 0);
+            checksum += them[i % NNUE_L1];
+        });
+        double transform = NanosecondsPerCall(iterations, [&](int i) {
+            k.transform(us, them, transformed.data());
+            checksum += transformed[i % (2 * NNUE_L1)];
+        });
+        double affine = NanosecondsPerCall(iterations, [&](int i) {
+            k.affine(layerInput.data(), 2 * NNUE_L1, l2Weights.data(), biases.data(), hidden.data(), NNUE_L2);
+            checksum += hidden[i % NNUE_L2];
+        });
+        double sparse = NanosecondsPerCall(iterations, [&](int i) {
+            k.affineSparse(layerInput.data(), 2 * NNUE_L1, l2Weights.data(), biases.data(), hidden.data(), NNUE_L2);
+            checksum += hidden[i % NNUE_L2];
+        });
+        double clip = NanosecondsPerCall(iterations, [&](int i) {
+            k.clip(hidden.data(), clipped.data(), NNUE_L2);
+            checksum += clipped[i % NNUE_L2];
+        });
+
+        std::cout << "info string " << k.name << " ns per call: update " << update << " refresh " << refreshTime
+                  << " transform " << transform << " affine " << affine << " sparse " << sparse << " clip " << clip << "\n";
+    }
+    std::cout << "info string checksum " << checksum << "\n";
+}
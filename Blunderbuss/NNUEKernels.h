@@ -0,0 +1,43 @@
+#pragma once
+#ifndef NNUEKERNELS_H
+#define NNUEKERNELS_H
+
+#include <cstdint>
+
+// One set of NNUE inference kernels per instruction set. The scalar set is the reference,
+// every other set must produce bit-identical results. The best set the CPU supports is
+// picked at startup so one binary runs on any x86-64 host.
+struct NNUEKernels
+{
+    const char* name;
+
+    // out = in + weight columns of added features - columns of removed ones, NNUE_L1 wide
+    void (*update)(const int16_t* in, int16_t* out, const int16_t* weights,
+                   const int* added, int addedCount, const int* removed, int removedCount);
+
+    // Clipped ReLU of both accumulator halves into 2 * NNUE_L1 bytes, us first
+    void (*transform)(const int16_t* us, const int16_t* them, uint8_t* output);
+
+    // Dense layer, weights are a row of inputSize per output. inputSize is a multiple of 32.
+    void (*affine)(const uint8_t* input, int inputSize, const int8_t* weights,
+                   const int32_t* biases, int32_t* output, int outputSize);
+
+    // Layer that skips zero inputs in groups of four. Weights are blocked as
+    // [inputSize / 4][outputSize][4], outputSize is a multiple of 16.
+    void (*affineSparse)(const uint8_t* input, int inputSize, const int8_t* weights,
+                         const int32_t* biases, int32_t* output, int outputSize);
+
+    // output = clamp(input >> NNUE_WEIGHT_SHIFT, 0, 127), size is a multiple of 32
+    void (*clip)(const int32_t* input, uint8_t* output, int size);
+};
+
+// Kernel sets the CPU supports, scalar first and the best last
+int SupportedKernels(const NNUEKernels** sets);
+
+// The best supported set
+const NNUEKernels* BestKernels();
+
+// Times every kernel of every supported set on random data and prints the results
+void BenchmarkKernels(int iterations);
+
+#endif // NNUEKERNELS_H
@@ -0,0 +1,127 @@
+#include "Numa.h"
+#include <vector>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sched.h>
+#endif
+
+#if defined(_WIN32)
+
+static std::vector<GROUP_AFFINITY> FindNodes()
+{
+    std::vector<GROUP_AFFINITY> nodes;
+    ULONG highest = 0;
+    if (!GetNumaHighestNodeNumber(&highest))
+        return nodes;
+    for (USHORT node = 0; node <= highest; ++node)
+    {
+        GROUP_AFFINITY affinity = {};
+        if (GetNumaNodeProcessorMaskEx(node, &affinity) && affinity.Mask)
+            nodes.push_back(affinity);
+    }
+    return nodes;
+}
+
+#else
+
+// Node processor lists from sysfs, like "0-15,32-47"
+static std::vector<std::vector<int>> FindNodes()
+{
+    std::vector<std::vector<int>> nodes;
+    for (int node = 0;; ++node)
+    {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (!file)
+            break;
+        std::string list, range;
+        std::getline(file, list);
+        std::istringstream ranges(list);
+        std::vector<int> cpus;
+        while (std::getline(ranges, range, ','))
+        {
+            size_t dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; ++cpu)
+                cpus.push_back(cpu);
+        }
+        if (!cpus.empty())
+            nodes.push_back(cpus);
+    }
+    return nodes;
+}
+
+#endif
+
+int NumaNodeCount()
+{
+    static const int count = (int)FindNodes().size();
+    return count > 0 ? count : 1;
+}
+
+void BindThreadToNode(int threadIndex)
+{
+    static const auto nodes = FindNodes();
+    if (nodes.size() < 2)
+        return;
+    const auto& node = nodes[threadIndex % nodes.size()];
+
+#if defined(_WIN32)
+    SetThreadGroupAffinity(GetCurrentThread(), &node, nullptr);
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : node)
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+#endif
+}
+
+void BindThreadToProcessor(int threadIndex)
+{
+#if defined(_WIN32)
+    WORD groups = GetActiveProcessorGroupCount();
+    DWORD total = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+    if (total == 0)
+        return;
+    DWORD index = threadIndex % total;
+    for (WORD group = 0; group < groups; ++group)
+    {
+        DWORD count = GetActiveProcessorCount(group);
+        if (index < count)
+        {
+            GROUP_AFFINITY affinity = {};
+            affinity.Group = group;
+            affinity.Mask = (KAFFINITY)1 << index;
+            SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr);
+            return;
+        }
+        index -= count;
+    }
+#else
+    // The processors allowed when the process started, before any thread was bound
+    static const std::vector<int> cpus = []() {
+        std::vector<int> allowed;
+        cpu_set_t set;
+        if (sched_getaffinity(0, sizeof(set), &set) == 0)
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+                if (CPU_ISSET(cpu, &set))
+                    allowed.push_back(cpu);
+        return allowed;
+    }();
+    if (cpus.empty())
+        return;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus[threadIndex % cpus.size()], &set);
+    sched_setaffinity(0, sizeof(set), &set);
+#endif
+}
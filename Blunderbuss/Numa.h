@@ -0,0 +1,17 @@
+#pragma once
+#ifndef NUMA_H
+#define NUMA_H
+
+// NUMA nodes with processors, 1 on machines without NUMA or where it can't be queried
+int NumaNodeCount();
+
+// Restricts the calling thread to the processors of one node, threads are spread round-robin
+// by index. Memory the thread touches first is then allocated on its node. Does nothing on
+// single-node machines.
+void BindThreadToNode(int threadIndex);
+
+// Restricts the calling thread to one logical processor, threads are spread round-robin by
+// index over the processors the process may run on
+void BindThreadToProcessor(int threadIndex);
+
+#endif // NUMA_H
@@ -0,0 +1,179 @@
+#include "Pawns.h"
+#include <intrin.h>
+#include <vector>
+
+constexpr int PAWN_TABLE_SIZE = 1 << 16; // entries, power of two
+
+static thread_local std::vector<PawnEntry> pawnTable;
+
+constexpr uint64_t FILE_A = 0x0101010101010101ULL;
+constexpr uint64_t FILE_H = 0x8080808080808080ULL;
+
+// Bonuses by rank from the pawn owner's side, index 0 is the first rank
+constexpr int passedMg[8] = { 0, 5, 10, 15, 30, 50, 80, 0 };
+constexpr int passedEg[8] = { 0, 10, 15, 25, 45, 75, 120, 0 };
+constexpr int candidateMg[8] = { 0, 3, 5, 8, 12, 20, 0, 0 };
+constexpr int candidateEg[8] = { 0, 5, 8, 12, 20, 35, 0, 0 };
+
+constexpr int isolatedMg = -10, isolatedEg = -15;
+constexpr int doubledMg = -10, doubledEg = -25;
+constexpr int backwardMg = -8, backwardEg = -10;
+constexpr int connectedMg = 7, connectedEg = 5;
+
+inline uint64_t NorthFill(uint64_t bb)
+{
+    bb |= bb << 8;
+    bb |= bb << 16;
+    bb |= bb << 32;
+    return bb;
+}
+
+inline uint64_t SouthFill(uint64_t bb)
+{
+    bb |= bb >> 8;
+    bb |= bb >> 16;
+    bb |= bb >> 32;
+    return bb;
+}
+
+inline uint64_t EastOne(uint64_t bb) { return (bb << 1) & ~FILE_A; }
+inline uint64_t WestOne(uint64_t bb) { return (bb >> 1) & ~FILE_H; }
+
+// Squares ahead of the pawns in their direction of travel, excluding the pawns
+inline uint64_t FrontSpan(uint64_t pawns, int color)
+{
+    return color == 0 ? NorthFill(pawns) << 8 : SouthFill(pawns) >> 8;
+}
+
+inline uint64_t RearSpan(uint64_t pawns, int color)
+{
+    return color == 0 ? SouthFill(pawns) >> 8 : NorthFill(pawns) << 8;
+}
+
+inline uint64_t PawnAttacks(uint64_t pawns, int color)
+{
+    uint64_t forward = color == 0 ? pawns << 8 : pawns >> 8;
+    return EastOne(forward) | WestOne(forward);
+}
+
+inline int RelativeRank(int square, int color)
+{
+    return color == 0 ? square / 8 : 7 - square / 8;
+}
+
+// Evaluates the pawns of one color, positive is good for that color
+static void EvaluatePawns(uint64_t own, uint64_t enemy, int color, int& mg, int& eg, uint64_t& passed)
+{
+    uint64_t ownFiles = SouthFill(NorthFill(own));
+    uint64_t adjacentFiles = EastOne(ownFiles) | WestOne(ownFiles);
+
+    uint64_t enemyFront = FrontSpan(enemy, !color);
+    uint64_t enemyAttackSpan = EastOne(enemyFront) | WestOne(enemyFront);
+    uint64_t ownAttacks = PawnAttacks(own, color);
+    uint64_t enemyAttacks = PawnAttacks(enemy, !color);
+
+    // Squares our pawns can cover by advancing, from where they stand now
+    uint64_t ownAttackSpan = color == 0 ? NorthFill(ownAttacks) : SouthFill(ownAttacks);
+
+    // Pawns with no enemy pawn ahead on their own or adjacent files, the rear one of doubled pawns excluded
+    passed = own & ~(enemyFront | enemyAttackSpan) & ~RearSpan(own, color);
+
+    uint64_t isolated = own & ~adjacentFiles;
+    uint64_t doubled = own & RearSpan(own, color);
+
+    // Stop square controlled by an enemy pawn and no own pawn can ever defend it
+    uint64_t stops = color == 0 ? own << 8 : own >> 8;
+    uint64_t backwardStops = stops & enemyAttacks & ~ownAttackSpan;
+    uint64_t backward = (color == 0 ? backwardStops >> 8 : backwardStops << 8) & ~isolated;
+
+    // Defended by a pawn or side by side with one
+    uint64_t phalanx = own & (EastOne(own) | WestOne(own));
+    uint64_t connected = own & (ownAttacks | phalanx);
+
+    mg = isolatedMg * (int)__popcnt64(isolated) + doubledMg * (int)__popcnt64(doubled)
+       + backwardMg * (int)__popcnt64(backward) + connectedMg * (int)__popcnt64(connected);
+    eg = isolatedEg * (int)__popcnt64(isolated) + doubledEg * (int)__popcnt64(doubled)
+       + backwardEg * (int)__popcnt64(backward) + connectedEg * (int)__popcnt64(connected);
+
+    uint64_t bb = passed;
+    while (bb)
+    {
+        unsigned long square;
+        _BitScanForward64(&square, bb);
+        bb &= bb - 1;
+        mg += passedMg[RelativeRank(square, color)];
+        eg += passedEg[RelativeRank(square, color)];
+    }
+
+    // Candidates: on a file without enemy pawns ahead and with at least as many
+    // own pawns able to support the advance as enemy pawns able to stop it
+    bb = own & ~enemyFront & ~passed & ~RearSpan(own, color);
+    while (bb)
+    {
+        unsigned long square;
+        _BitScanForward64(&square, bb);
+        bb &= bb - 1;
+
+        uint64_t file = SouthFill(NorthFill(1ULL << square));
+        uint64_t neighbours = EastOne(file) | WestOne(file);
+        int rank = square / 8;
+        uint64_t ranksAhead = color == 0 ? ~0ULL << (8 * (rank + 1)) : (1ULL << (8 * rank)) - 1;
+        uint64_t sentries = enemy & neighbours & ranksAhead;
+        uint64_t helpers = own & neighbours & ~ranksAhead;
+
+        if (__popcnt64(helpers) >= __popcnt64(sentries))
+        {
+            mg += candidateMg[RelativeRank(square, color)];
+            eg += candidateEg[RelativeRank(square, color)];
+        }
+    }
+}
+
+const PawnEntry* ProbePawns(Board* board)
+{
+    if (pawnTable.empty())
+        pawnTable.resize(PAWN_TABLE_SIZE);
+
+    searchStats.pawnProbes++;
+
+    PawnEntry* entry = &pawnTable[board->pawnKey & (PAWN_TABLE_SIZE - 1)];
+    if (entry->key == board->pawnKey)
+    {
+        searchStats.pawnHits++;
+        return entry;
+    }
+
+    int mgWhite, egWhite, mgBlack, egBlack;
+    EvaluatePawns(board->pieces[0][0], board->pieces[1][0], 0, mgWhite, egWhite, entry->passed[0]);
+    EvaluatePawns(board->pieces[1][0], board->pieces[0][0], 1, mgBlack, egBlack, entry->passed[1]);
+
+    entry->key = board->pawnKey;
+    entry->mg = mgWhite - mgBlack;
+    entry->eg = egWhite - egBlack;
+    return entry;
+}
+
+void PrefetchPawns(uint64_t pawnKey)
+{
+    if (!pawnTable.empty())
+        _mm_prefetch((const char*)&pawnTable[pawnKey & (PAWN_TABLE_SIZE - 1)], _MM_HINT_T0);
+}
+
+const PawnEntry* PeekPawns(Board* board)
+{
+    if (pawnTable.empty())
+        return nullptr;
+
+    const PawnEntry* entry = &pawnTable[board->pawnKey & (PAWN_TABLE_SIZE - 1)];
+    if (entry->key != board->pawnKey)
+        return nullptr;
+
+    searchStats.pawnProbes++;
+    searchStats.pawnHits++;
+    return entry;
+}
+
+void ClearPawnTable()
+{
+    pawnTable.assign(PAWN_TABLE_SIZE, PawnEntry());
+}
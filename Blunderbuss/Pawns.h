@@ -0,0 +1,30 @@
+#pragma once
+#ifndef PAWNS_H
+#define PAWNS_H
+
+#include <cstdint>
+#include "Board.h"
+
+// Pawn structure evaluation for one pawn configuration, from white's point of view
+struct PawnEntry
+{
+    uint64_t key;
+    int mg;
+    int eg;
+    uint64_t passed[2]; // passed pawns per color, for terms that also depend on pieces
+};
+
+// Returns the pawn structure evaluation of the position, computed on a miss and
+// cached in a per-thread table keyed by board->pawnKey
+const PawnEntry* ProbePawns(Board* board);
+
+// Returns the cached entry for the position, or nullptr if it would have to be computed
+const PawnEntry* PeekPawns(Board* board);
+
+// Starts loading the entry for a pawn key into the cache
+void PrefetchPawns(uint64_t pawnKey);
+
+// Drops all cached entries of the calling thread's table
+void ClearPawnTable();
+
+#endif // PAWNS_H
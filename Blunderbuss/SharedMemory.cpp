@@ -0,0 +1,120 @@
+#include "SharedMemory.h"
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <map>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+// Views and the mappings behind them, the mapping has to stay open while the view is used
+static std::map<void*, HANDLE> mappings;
+
+void* OpenShared(const std::string& name, size_t& size, bool& created)
+{
+    std::string fullName = "Local\\" + name;
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                        (DWORD)((uint64_t)size >> 32), (DWORD)size, fullName.c_str());
+    if (!mapping)
+        return nullptr;
+    created = GetLastError() != ERROR_ALREADY_EXISTS;
+
+    // An existing mapping keeps its own size, map all of it
+    void* memory = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (!memory)
+    {
+        CloseHandle(mapping);
+        return nullptr;
+    }
+
+    MEMORY_BASIC_INFORMATION info;
+    VirtualQuery(memory, &info, sizeof(info));
+    if (!created)
+        size = info.RegionSize;
+    mappings[memory] = mapping;
+    return memory;
+}
+
+void CloseShared(void* memory, size_t size)
+{
+    if (!memory)
+        return;
+
+    UnmapViewOfFile(memory);
+    auto it = mappings.find(memory);
+    if (it != mappings.end())
+    {
+        CloseHandle(it->second);
+        mappings.erase(it);
+    }
+}
+
+#else
+
+void* OpenShared(const std::string& name, size_t& size, bool& created)
+{
+    std::string fullName = name[0] == '/' ? name : "/" + name;
+
+    // Exactly one process creates the segment and sets its size
+    int fd = shm_open(fullName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    created = fd >= 0;
+    if (created)
+    {
+        if (ftruncate(fd, (off_t)size) != 0)
+        {
+            close(fd);
+            shm_unlink(fullName.c_str());
+            return nullptr;
+        }
+    }
+    else
+    {
+        if (errno != EEXIST)
+            return nullptr;
+        fd = shm_open(fullName.c_str(), O_RDWR, 0600);
+        if (fd < 0)
+            return nullptr;
+
+        // The creator may not have set the size yet
+        struct stat status;
+        for (int tries = 0; ; ++tries)
+        {
+            if (fstat(fd, &status) != 0 || tries == 1000)
+            {
+                close(fd);
+                return nullptr;
+            }
+            if (status.st_size > 0)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        size = (size_t)status.st_size;
+    }
+
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // the mapping keeps the segment open
+    if (memory == MAP_FAILED)
+        return nullptr;
+
+    // Shared memory gets large pages only where the kernel allows them for shmem
+    madvise(memory, size, MADV_HUGEPAGE);
+    return memory;
+}
+
+void CloseShared(void* memory, size_t size)
+{
+    if (memory)
+        munmap(memory, size);
+}
+
+#endif
@@ -0,0 +1,17 @@
+#pragma once
+#ifndef SHAREDMEMORY_H
+#define SHAREDMEMORY_H
+
+#include <cstddef>
+#include <string>
+
+// Maps a named segment that every process opening the same name shares. It is created with
+// the requested size if it doesn't exist yet, and then starts zero filled. On return size holds
+// the segment's actual size and created whether this call made it. Returns nullptr on failure.
+// On Linux the segment lives in /dev/shm until it is removed or the machine restarts, on
+// Windows until the last process using it closes it.
+void* OpenShared(const std::string& name, size_t& size, bool& created);
+
+void CloseShared(void* memory, size_t size);
+
+#endif // SHAREDMEMORY_H
@@ -0,0 +1,580 @@
+#include "TT.h"
+#include "LargePages.h"
+#include "ThreadPool.h"
+#include "SharedMemory.h"
+#include <intrin.h>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Entries keep only 16 bits of the key, the cluster index supplies the rest. Without
+// a full key they fit in 8 bytes, four to a 32-byte cluster, two clusters per cache line.
+struct PackedEntry
+{
+    uint16_t key16;
+    uint16_t move;
+    int16_t score;
+    int8_t depth;
+    uint8_t genFlag; // search generation in the upper 6 bits, TTFlag in the lower 2
+};
+
+constexpr int CLUSTER_SIZE = 4;
+constexpr uint8_t GENERATION_DELTA = 4; // one search, the flag bits are below it
+constexpr uint8_t FLAG_MASK = GENERATION_DELTA - 1;
+
+// Entries are read and written whole as one 64-bit word, without locks, so threads and
+// processes sharing the table can race on them. The key is stored xored with the rest of
+// the entry: a torn or mixed-up entry fails the key check and reads as a miss.
+struct alignas(32) Cluster
+{
+    std::atomic<uint64_t> entries[CLUSTER_SIZE];
+};
+
+static_assert(sizeof(Cluster) == 32, "a cluster must fill half a cache line");
+
+inline uint16_t EntryCheck(const PackedEntry& entry)
+{
+    return entry.move ^ (uint16_t)entry.score ^ (uint16_t)((uint8_t)entry.depth | entry.genFlag << 8);
+}
+
+inline PackedEntry LoadEntry(const std::atomic<uint64_t>& slot)
+{
+    uint64_t word = slot.load(std::memory_order_relaxed);
+    PackedEntry entry;
+    memcpy(&entry, &word, sizeof(entry));
+    entry.key16 ^= EntryCheck(entry);
+    return entry;
+}
+
+inline void StoreEntry(std::atomic<uint64_t>& slot, PackedEntry entry)
+{
+    entry.key16 ^= EntryCheck(entry);
+    uint64_t word;
+    memcpy(&word, &entry, sizeof(word));
+    slot.store(word, std::memory_order_relaxed);
+}
+
+// A shared table starts with this header, the clusters follow it
+constexpr uint32_t SHARED_READY = 0x48534242; // "BBSH"
+constexpr uint32_t SHARED_VERSION = 1;
+static const char TT_BUILD[] = "Blunderbuss " __DATE__ " " __TIME__;
+
+struct SharedHeader
+{
+    std::atomic<uint32_t> ready; // SHARED_READY once the creator has filled in the rest
+    uint32_t version;
+    uint32_t clusterBytes;
+    std::atomic<uint8_t> generation; // every process's searches age the entries
+    char build[48];
+};
+
+static_assert(sizeof(SharedHeader) == 64, "the header keeps the clusters aligned");
+
+static Cluster* table = nullptr;
+static size_t tableSize = 0; // clusters
+static uint64_t tableMask = 0;
+static bool tableLargePages = false;
+static SharedHeader* shared = nullptr; // the segment when the table is shared
+static size_t sharedBytes = 0;
+static std::atomic<uint8_t> privateGeneration(0);
+static std::atomic<uint8_t>* generation = &privateGeneration;
+static TTReplacement replacement = TT_REPLACE_AGED;
+
+inline uint16_t Key16(uint64_t key)
+{
+    return (uint16_t)(key >> 48); // the index uses the low bits
+}
+
+inline uint8_t Generation()
+{
+    return generation->load(std::memory_order_relaxed);
+}
+
+// Searches since the entry was last written
+inline int Age(const PackedEntry& entry)
+{
+    return (uint8_t)(Generation() - (entry.genFlag & ~FLAG_MASK)) / GENERATION_DELTA;
+}
+
+// Cluster count for a size in bytes, a power of two so the index is a mask
+static size_t ClusterCount(size_t bytes)
+{
+    size_t count = 1;
+    while (count * 2 * sizeof(Cluster) <= bytes)
+        count *= 2;
+    return count;
+}
+
+// Drops the current table, private or shared
+static void ReleaseTable()
+{
+    if (shared)
+    {
+        CloseShared(shared, sharedBytes);
+        shared = nullptr;
+        generation = &privateGeneration;
+    }
+    else
+    {
+        FreeLarge(table);
+    }
+    table = nullptr;
+    tableSize = 0;
+}
+
+void TTResize(size_t megabytes)
+{
+    size_t count = ClusterCount(megabytes * 1024 * 1024);
+
+    ReleaseTable();
+    table = (Cluster*)AllocateLarge(count * sizeof(Cluster));
+    tableSize = table ? count : 0;
+    tableMask = count - 1;
+
+    // The clear is the first touch, it decides where the pages go
+    TTClear();
+    tableLargePages = table && HasLargePages(table);
+}
+
+bool TTAttachShared(const std::string& name, size_t megabytes)
+{
+    size_t bytes = sizeof(SharedHeader) + ClusterCount(megabytes * 1024 * 1024) * sizeof(Cluster);
+    bool created;
+    SharedHeader* header = (SharedHeader*)OpenShared(name, bytes, created);
+    if (!header)
+        return false;
+
+    if (created)
+    {
+        // A new segment is zero filled, which is an empty table
+        header->version = SHARED_VERSION;
+        header->clusterBytes = sizeof(Cluster);
+        strncpy(header->build, TT_BUILD, sizeof(header->build) - 1);
+        header->ready.store(SHARED_READY, std::memory_order_release);
+    }
+    else
+    {
+        // Wait for the creator, then check the entries mean the same to both builds
+        for (int tries = 0; header->ready.load(std::memory_order_acquire) != SHARED_READY; ++tries)
+        {
+            if (tries == 1000)
+            {
+                CloseShared(header, bytes);
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (header->version != SHARED_VERSION || header->clusterBytes != sizeof(Cluster)
+            || strncmp(header->build, TT_BUILD, sizeof(header->build)) != 0
+            || bytes < sizeof(SharedHeader) + sizeof(Cluster))
+        {
+            CloseShared(header, bytes);
+            return false;
+        }
+    }
+
+    // An existing segment keeps the size its creator gave it
+    ReleaseTable();
+    shared = header;
+    sharedBytes = bytes;
+    generation = &header->generation;
+    table = (Cluster*)(header + 1);
+    tableSize = ClusterCount(bytes - sizeof(SharedHeader));
+    tableMask = tableSize - 1;
+    tableLargePages = false;
+    return true;
+}
+
+bool TTShared()
+{
+    return shared != nullptr;
+}
+
+// Calls work(begin, end) on one slice of the clusters per pool thread, from that thread. With
+// the pool pinned to NUMA nodes the first touch spreads the slices over the nodes the search
+// threads run on.
+template<typename Work>
+static void ForEachSlice(Work work)
+{
+    RunOnEveryThread([](void* data) {
+        size_t slices = std::max(PoolThreads(), 1);
+        size_t slice = std::max(PoolThreadIndex(), 0);
+        (*(Work*)data)(tableSize * slice / slices, tableSize * (slice + 1) / slices);
+    }, &work);
+}
+
+void TTClear()
+{
+    // Other processes may be searching with a shared table
+    if (!table || shared)
+        return;
+
+    privateGeneration = 0;
+    ForEachSlice([](size_t begin, size_t end) {
+        memset((void*)(table + begin), 0, (end - begin) * sizeof(Cluster));
+    });
+}
+
+// Hash file layout: the header, then the clusters exactly as they are in memory. Entries only
+// make sense to the build that wrote them, keys and scores change with the engine.
+constexpr uint32_t TT_FILE_VERSION = 2;
+
+struct TTFileHeader
+{
+    char magic[4]; // "BBTT"
+    uint32_t version;
+    uint32_t clusterBytes;
+    uint32_t generation;
+    uint64_t clusters;
+    char build[40];
+};
+
+static_assert(sizeof(TTFileHeader) == 64, "the header keeps the clusters aligned");
+
+bool TTSave(const std::string& path)
+{
+    if (!table)
+        return false;
+
+    TTFileHeader header = {};
+    memcpy(header.magic, "BBTT", 4);
+    header.version = TT_FILE_VERSION;
+    header.clusterBytes = sizeof(Cluster);
+    header.generation = Generation();
+    header.clusters = tableSize;
+    strncpy(header.build, TT_BUILD, sizeof(header.build) - 1);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    // Written in large chunks straight from the table
+    constexpr size_t CHUNK = 64 * 1024 * 1024;
+    const char* data = reinterpret_cast<const char*>(table);
+    size_t bytes = tableSize * sizeof(Cluster);
+    for (size_t offset = 0; out && offset < bytes; offset += CHUNK)
+        out.write(data + offset, (std::streamsize)std::min(CHUNK, bytes - offset));
+    out.close();
+    return !out.fail();
+}
+
+// A read-only view of a whole file
+struct MappedFile
+{
+    const char* data = nullptr;
+    size_t size = 0;
+#if defined(_WIN32)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
+
+#if defined(_WIN32)
+
+static bool MapFile(const std::string& path, MappedFile& mapped)
+{
+    mapped.file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (mapped.file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mapped.file, &size) || size.QuadPart == 0)
+        return false;
+    mapped.mapping = CreateFileMappingA(mapped.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapped.mapping)
+        return false;
+    mapped.data = (const char*)MapViewOfFile(mapped.mapping, FILE_MAP_READ, 0, 0, 0);
+    mapped.size = (size_t)size.QuadPart;
+    return mapped.data != nullptr;
+}
+
+static void UnmapFile(MappedFile& mapped)
+{
+    if (mapped.data)
+        UnmapViewOfFile(mapped.data);
+    if (mapped.mapping)
+        CloseHandle(mapped.mapping);
+    if (mapped.file != INVALID_HANDLE_VALUE)
+        CloseHandle(mapped.file);
+}
+
+#else
+
+static bool MapFile(const std::string& path, MappedFile& mapped)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file open
+    if (data == MAP_FAILED)
+        return false;
+
+    // One pass front to back, let the kernel read ahead as far as it likes
+    madvise(data, (size_t)status.st_size, MADV_SEQUENTIAL);
+    madvise(data, (size_t)status.st_size, MADV_WILLNEED);
+    mapped.data = (const char*)data;
+    mapped.size = (size_t)status.st_size;
+    return true;
+}
+
+static void UnmapFile(MappedFile& mapped)
+{
+    if (mapped.data)
+        munmap((void*)mapped.data, mapped.size);
+}
+
+#endif
+
+bool TTLoad(const std::string& path)
+{
+    MappedFile file;
+    if (!MapFile(path, file))
+    {
+        UnmapFile(file);
+        return false;
+    }
+
+    TTFileHeader header;
+    bool valid = file.size >= sizeof(header);
+    if (valid)
+    {
+        memcpy(&header, file.data, sizeof(header));
+        header.build[sizeof(header.build) - 1] = 0;
+        valid = memcmp(header.magic, "BBTT", 4) == 0 && header.version == TT_FILE_VERSION
+            && header.clusterBytes == sizeof(Cluster) && strcmp(header.build, TT_BUILD) == 0
+            && header.clusters != 0 && (header.clusters & (header.clusters - 1)) == 0
+            && file.size - sizeof(header) == header.clusters * sizeof(Cluster);
+    }
+
+    Cluster* loaded = valid ? (Cluster*)AllocateLarge(header.clusters * sizeof(Cluster)) : nullptr;
+    if (!loaded)
+    {
+        UnmapFile(file);
+        return false;
+    }
+
+    // The table takes the file's size. Copying from the mapping in parallel keeps several
+    // reads in flight, so the load runs at disk speed, and is the first touch of the table.
+    ReleaseTable();
+    table = loaded;
+    tableSize = header.clusters;
+    tableMask = header.clusters - 1;
+    const Cluster* source = (const Cluster*)(file.data + sizeof(header));
+    ForEachSlice([source](size_t begin, size_t end) {
+        memcpy((void*)(table + begin), source + begin, (end - begin) * sizeof(Cluster));
+    });
+    privateGeneration = (uint8_t)header.generation;
+    tableLargePages = HasLargePages(table);
+
+    UnmapFile(file);
+    return true;
+}
+
+size_t TTSizeMB()
+{
+    return tableSize * sizeof(Cluster) / (1024 * 1024);
+}
+
+bool TTLargePages()
+{
+    return tableLargePages;
+}
+
+void TTNewSearch()
+{
+    generation->fetch_add(GENERATION_DELTA, std::memory_order_relaxed);
+}
+
+void TTSetReplacement(TTReplacement policy)
+{
+    replacement = policy;
+}
+
+int TTHashfull()
+{
+    if (!table)
+        return 0;
+
+    // Entries written by the current search in the first clusters, per mille
+    size_t clusters = tableSize < 1000 ? tableSize : 1000;
+    int used = 0;
+    for (size_t i = 0; i < clusters; ++i)
+        for (const std::atomic<uint64_t>& slot : table[i].entries)
+        {
+            PackedEntry entry = LoadEntry(slot);
+            if ((entry.genFlag & FLAG_MASK) != TT_NONE && Age(entry) == 0)
+                used++;
+        }
+    return (int)(used * 1000 / (clusters * CLUSTER_SIZE));
+}
+
+void TTPrefetch(uint64_t key)
+{
+    if (table)
+        _mm_prefetch((const char*)&table[key & tableMask], _MM_HINT_T0);
+}
+
+bool TTProbe(uint64_t key, TTEntry& entry)
+{
+    if (!table) return false;
+
+    Cluster& cluster = table[key & tableMask];
+    uint16_t key16 = Key16(key);
+    for (std::atomic<uint64_t>& slot : cluster.entries)
+    {
+        PackedEntry packed = LoadEntry(slot);
+        if (packed.key16 == key16 && (packed.genFlag & FLAG_MASK) != TT_NONE)
+        {
+            // Refresh the age so entries still in use survive replacement
+            uint8_t refreshed = Generation() | (packed.genFlag & FLAG_MASK);
+            if (packed.genFlag != refreshed)
+            {
+                packed.genFlag = refreshed;
+                StoreEntry(slot, packed);
+            }
+            entry.key = key;
+            entry.score = packed.score;
+            entry.move = packed.move;
+            entry.depth = packed.depth;
+            entry.flag = packed.genFlag & FLAG_MASK;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TTStore(uint64_t key, int depth, int score, int flag, uint16_t move)
+{
+    if (!table) return;
+
+    Cluster& cluster = table[key & tableMask];
+    uint16_t key16 = Key16(key);
+    PackedEntry entries[CLUSTER_SIZE];
+    for (int i = 0; i < CLUSTER_SIZE; ++i)
+        entries[i] = LoadEntry(cluster.entries[i]);
+
+    // The position's own entry or an empty one if there is one, otherwise the entry
+    // worth least: shallow, or left over from earlier searches
+    int slot = -1;
+    for (int i = 0; i < CLUSTER_SIZE; ++i)
+    {
+        if (entries[i].key16 == key16 || (entries[i].genFlag & FLAG_MASK) == TT_NONE)
+        {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0)
+    {
+        slot = 0;
+        for (int i = 0; i < CLUSTER_SIZE; ++i)
+        {
+            if (replacement == TT_REPLACE_ALWAYS)
+                break;
+            int worth = entries[i].depth - (replacement == TT_REPLACE_AGED ? 8 * Age(entries[i]) : 0);
+            int slotWorth = entries[slot].depth - (replacement == TT_REPLACE_AGED ? 8 * Age(entries[slot]) : 0);
+            if (worth < slotWorth)
+                slot = i;
+        }
+    }
+    else if (entries[slot].key16 == key16 && (entries[slot].genFlag & FLAG_MASK) != TT_NONE)
+    {
+        // Keep the old hash move if we have none for the same position
+        if (move == 0)
+            move = entries[slot].move;
+
+        // Prefer deeper results for the same position from this search
+        if (replacement != TT_REPLACE_ALWAYS && depth < entries[slot].depth && flag != TT_EXACT && Age(entries[slot]) == 0)
+        {
+            if (entries[slot].move != move)
+            {
+                entries[slot].move = move;
+                StoreEntry(cluster.entries[slot], entries[slot]);
+            }
+            return;
+        }
+    }
+
+    PackedEntry entry;
+    entry.key16 = key16;
+    entry.score = (int16_t)score;
+    entry.move = move;
+    entry.depth = (int8_t)depth;
+    entry.genFlag = Generation() | (uint8_t)flag;
+    StoreEntry(cluster.entries[slot], entry);
+}
+
+// Chases dependent random probes through a table so every probe waits for the previous one,
+// which measures the latency of a miss rather than the throughput
+static double ProbeLatency(Cluster* clusters, size_t count, int probes)
+{
+    // Each cluster holds the index of the next one to load
+    uint64_t mask = count - 1;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; i < count; ++i)
+    {
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        memcpy((void*)&clusters[i], &seed, sizeof(seed));
+    }
+
+    uint64_t index = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < probes; ++i)
+    {
+        uint64_t next;
+        memcpy(&next, (const void*)&clusters[index], sizeof(next));
+        index = (next + i) & mask;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    volatile uint64_t sink = index;
+    (void)sink;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / probes;
+}
+
+void TTBenchmark(size_t megabytes, int probes)
+{
+    size_t count = 1;
+    while (count * 2 * sizeof(Cluster) <= megabytes * 1024 * 1024)
+        count *= 2;
+
+    Cluster* large = (Cluster*)AllocateLarge(count * sizeof(Cluster));
+    if (large)
+    {
+        double latency = ProbeLatency(large, count, probes);
+        std::cout << "info string " << megabytes << " MB with large pages " << (HasLargePages(large) ? "obtained" : "not available")
+                  << ": " << latency << " ns per probe\n";
+        FreeLarge(large);
+    }
+
+    Cluster* small = (Cluster*)AllocateSmall(count * sizeof(Cluster));
+    if (small)
+    {
+        double latency = ProbeLatency(small, count, probes);
+        std::cout << "info string " << megabytes << " MB with ordinary pages: " << latency << " ns per probe\n";
+        FreeLarge(small);
+    }
+}
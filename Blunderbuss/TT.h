@@ -0,0 +1,107 @@
+#pragma once
+#ifndef TT_H
+#define TT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include "Board.h"
+
+enum TTFlag : uint8_t
+{
+    TT_NONE = 0,
+    TT_EXACT = 1,
+    TT_LOWER = 2, // score is a lower bound (fail high)
+    TT_UPPER = 3  // score is an upper bound (fail low)
+};
+
+// A probe result, the table itself stores packed entries in clusters
+struct TTEntry
+{
+    uint64_t key;
+    int32_t score;
+    uint16_t move; // packed move, see EncodeMove, 0 if none
+    int8_t depth;
+    uint8_t flag;
+};
+
+// Packs the parts of a move that identify it into 16 bits: from | to << 6 | special << 12
+inline uint16_t EncodeMove(const Move& move)
+{
+    if (move.pieceType == -1) return 0;
+    return (uint16_t)(move.from | (move.to << 6) | (move.special << 12));
+}
+
+// Mate scores are stored relative to the node rather than the root, so they
+// stay correct when the position is reached again at a different ply
+inline int ScoreToTT(int score, int ply)
+{
+    if (score >= SCORE_MATE_IN_MAX_PLY) return score + ply;
+    if (score <= -SCORE_MATE_IN_MAX_PLY) return score - ply;
+    return score;
+}
+
+inline int ScoreFromTT(int score, int ply)
+{
+    if (score >= SCORE_MATE_IN_MAX_PLY) return score - ply;
+    if (score <= -SCORE_MATE_IN_MAX_PLY) return score + ply;
+    return score;
+}
+
+// Allocate the table with the given size in megabytes, dropping all entries.
+// The table is 2 MB aligned and backed by large pages where the OS grants them.
+void TTResize(size_t megabytes);
+
+// Clears the table with every thread of the pool, each zeroing its own slice where it runs.
+// A shared table is left alone, other processes may be using it.
+void TTClear();
+
+// Replaces the table with a named shared-memory one, so engine processes on one machine that
+// attach to the same name share their search results. The first process creates it with the
+// given size, later ones take that size. Returns false and keeps the table on failure.
+bool TTAttachShared(const std::string& name, size_t megabytes);
+
+// Whether the table is a shared one
+bool TTShared();
+
+// Writes the table to a file with a header recording its size, the file version and the build
+bool TTSave(const std::string& path);
+
+// Replaces the table with one saved by TTSave from this build, taking its size. The file is
+// mapped and copied by every thread of the pool. Returns false and keeps the table on failure.
+bool TTLoad(const std::string& path);
+
+// Table size in megabytes
+size_t TTSizeMB();
+
+// Starts a new search, entries from earlier ones age and are replaced first
+void TTNewSearch();
+
+// How a full cluster picks the entry to overwrite
+enum TTReplacement
+{
+    TT_REPLACE_AGED,   // shallowest, with every search of age counting as 8 plies
+    TT_REPLACE_DEPTH,  // shallowest regardless of age
+    TT_REPLACE_ALWAYS  // the first one, and results for the same position always overwrite
+};
+
+void TTSetReplacement(TTReplacement policy);
+
+// Per mille of sampled entries written by the current search, for "info hashfull"
+int TTHashfull();
+
+// Whether the current table got large pages
+bool TTLargePages();
+
+// Measures probe latency on a table of the given size with and without large pages
+void TTBenchmark(size_t megabytes, int probes);
+
+// Starts loading the slot of a position into the cache, call it as soon as the key is known
+void TTPrefetch(uint64_t key);
+
+// Returns true and fills entry if the position is in the table
+bool TTProbe(uint64_t key, TTEntry& entry);
+
+void TTStore(uint64_t key, int depth, int score, int flag, uint16_t move);
+
+#endif // TT_H
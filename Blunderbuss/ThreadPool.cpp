@@ -0,0 +1,357 @@
+#include "ThreadPool.h"
+#include "Numa.h"
+#include <intrin.h>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+constexpr int64_t DEQUE_CAPACITY = 4096; // a power of two, a full deque runs new tasks inline
+
+// Chase-Lev deque as formulated for C11 atomics by Le, Pop, Cohen and Zappa Nardelli.
+// Only the owner touches the bottom, thieves race for the top with a CAS.
+struct WorkDeque
+{
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    alignas(64) std::atomic<Task*> buffer[DEQUE_CAPACITY];
+    std::atomic<Task*> own{nullptr}; // a task only this thread may run, set by RunOnEveryThread
+};
+
+static std::vector<std::unique_ptr<WorkDeque>> deques; // one per thread, thread 0's first
+static std::vector<std::thread> workers;
+static std::atomic<bool> stopping(false);
+static ThreadPinning poolPinning = PIN_NONE;
+
+// Parking: a thread counts itself in parked before its last look for work, a spawner
+// publishes its task before reading parked, so one of them always sees the other
+static std::mutex parkMutex;
+static std::condition_variable parkSignal;
+static std::atomic<int> parked(0);
+static std::atomic<uint64_t> wakeups(0);
+
+static thread_local int threadIndex = -1;
+static thread_local uint64_t stealSeed = 0;
+
+static bool Push(WorkDeque& deque, Task* task)
+{
+    int64_t b = deque.bottom.load(std::memory_order_relaxed);
+    int64_t t = deque.top.load(std::memory_order_acquire);
+    if (b - t >= DEQUE_CAPACITY)
+        return false;
+    deque.buffer[b & (DEQUE_CAPACITY - 1)].store(task, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    deque.bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+static Task* Pop(WorkDeque& deque)
+{
+    int64_t b = deque.bottom.load(std::memory_order_relaxed) - 1;
+    deque.bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = deque.top.load(std::memory_order_relaxed);
+
+    Task* task = nullptr;
+    if (t <= b)
+    {
+        task = deque.buffer[b & (DEQUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (t == b)
+        {
+            // The last task, a thief may be taking it too
+            if (!deque.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                task = nullptr;
+            deque.bottom.store(b + 1, std::memory_order_relaxed);
+        }
+    }
+    else
+    {
+        deque.bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return task;
+}
+
+static Task* Steal(WorkDeque& deque)
+{
+    int64_t t = deque.top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = deque.bottom.load(std::memory_order_acquire);
+    if (t >= b)
+        return nullptr;
+
+    Task* task = deque.buffer[t & (DEQUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (!deque.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr; // lost the race, the caller moves on
+    return task;
+}
+
+// Tries every other thread once, starting from a random one so thieves spread out
+static Task* StealAny(int self)
+{
+    int count = (int)deques.size();
+    stealSeed ^= stealSeed << 13; stealSeed ^= stealSeed >> 7; stealSeed ^= stealSeed << 17;
+    int start = (int)(stealSeed % count);
+    for (int i = 0; i < count; ++i)
+    {
+        int victim = (start + i) % count;
+        if (victim == self)
+            continue;
+        if (Task* task = Steal(*deques[victim]))
+            return task;
+    }
+    return nullptr;
+}
+
+static Task* FindTask(int self)
+{
+    WorkDeque& deque = *deques[self];
+    if (deque.own.load(std::memory_order_relaxed))
+        return deque.own.exchange(nullptr, std::memory_order_acquire);
+
+    Task* task = Pop(deque);
+    return task ? task : StealAny(self);
+}
+
+static void RunTask(Task* task)
+{
+    TaskGroup* group = task->group;
+    task->run(task->data);
+    group->pending.fetch_sub(1, std::memory_order_release);
+}
+
+static bool AnyQueued()
+{
+    for (const auto& deque : deques)
+        if (deque->top.load(std::memory_order_relaxed) < deque->bottom.load(std::memory_order_relaxed)
+            || deque->own.load(std::memory_order_relaxed))
+            return true;
+    return false;
+}
+
+static void WorkerLoop(int index)
+{
+    threadIndex = index;
+    stealSeed = 0x9E3779B97F4A7C15ULL * (index + 1);
+    if (poolPinning == PIN_NODES)
+        BindThreadToNode(index);
+    else if (poolPinning == PIN_PROCESSORS)
+        BindThreadToProcessor(index);
+
+    while (!stopping.load(std::memory_order_relaxed))
+    {
+        // Spin briefly before parking, tasks often come in bursts
+        Task* task = nullptr;
+        for (int spin = 0; spin < 256 && !task; ++spin)
+        {
+            task = FindTask(index);
+            if (!task)
+                _mm_pause();
+        }
+        if (task)
+        {
+            RunTask(task);
+            continue;
+        }
+
+        uint64_t seen = wakeups.load(std::memory_order_seq_cst);
+        parked.fetch_add(1, std::memory_order_seq_cst);
+        if (!AnyQueued())
+        {
+            std::unique_lock<std::mutex> lock(parkMutex);
+            parkSignal.wait(lock, [seen]() {
+                return stopping.load() || wakeups.load() != seen;
+            });
+        }
+        parked.fetch_sub(1, std::memory_order_seq_cst);
+    }
+}
+
+void StartPool(int threads, ThreadPinning pinning)
+{
+    StopPool();
+    poolPinning = pinning;
+    stopping = false;
+    for (int i = 0; i < threads; ++i)
+        deques.push_back(std::make_unique<WorkDeque>());
+
+    // The calling thread is thread 0, it stays where it is
+    threadIndex = 0;
+    stealSeed = 0x9E3779B97F4A7C15ULL;
+    for (int i = 1; i < threads; ++i)
+        workers.emplace_back(WorkerLoop, i);
+}
+
+void StopPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(parkMutex);
+        stopping = true;
+    }
+    parkSignal.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+    workers.clear();
+    deques.clear();
+}
+
+int PoolThreads()
+{
+    return (int)deques.size();
+}
+
+int PoolThreadIndex()
+{
+    return threadIndex;
+}
+
+void Spawn(Task* task)
+{
+    task->group->pending.fetch_add(1, std::memory_order_relaxed);
+    if (threadIndex < 0 || threadIndex >= (int)deques.size() || !Push(*deques[threadIndex], task))
+    {
+        RunTask(task);
+        return;
+    }
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (parked.load(std::memory_order_relaxed) > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(parkMutex);
+            wakeups.fetch_add(1);
+        }
+        parkSignal.notify_one();
+    }
+}
+
+void Wait(TaskGroup* group)
+{
+    while (group->pending.load(std::memory_order_acquire) > 0)
+    {
+        Task* task = threadIndex >= 0 && threadIndex < (int)deques.size() ? FindTask(threadIndex) : nullptr;
+        if (task)
+            RunTask(task);
+        else
+            _mm_pause();
+    }
+}
+
+void RunOnEveryThread(void (*run)(void* data), void* data)
+{
+    int count = (int)deques.size();
+    if (count <= 1 || threadIndex > 0)
+    {
+        run(data);
+        return;
+    }
+
+    TaskGroup group;
+    std::vector<Task> tasks(count, { run, data, &group });
+    group.pending.store(count - 1, std::memory_order_relaxed);
+    for (int i = 1; i < count; ++i)
+        deques[i]->own.store(&tasks[i], std::memory_order_release);
+
+    // Every thread has to run its own task, so all of them are woken
+    {
+        std::lock_guard<std::mutex> lock(parkMutex);
+        wakeups.fetch_add(1);
+    }
+    parkSignal.notify_all();
+
+    run(data);
+    Wait(&group);
+}
+
+// A few hundred nanoseconds of work
+static void SmallTask(void* data)
+{
+    uint64_t x = *(uint64_t*)data;
+    for (int i = 0; i < 100; ++i)
+    {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    }
+    *(uint64_t*)data = x;
+}
+
+// A node of a binary fork-join tree, every node spawns its children from whichever
+// thread runs it, so the work is spread by stealing alone
+struct TreeNode
+{
+    int depth;
+    uint64_t value;
+};
+
+static void RunTreeNode(void* data)
+{
+    TreeNode* node = (TreeNode*)data;
+    if (node->depth == 0)
+    {
+        SmallTask(&node->value);
+        return;
+    }
+
+    TaskGroup group;
+    TreeNode left = { node->depth - 1, node->value * 2 + 1 };
+    TreeNode right = { node->depth - 1, node->value * 2 + 2 };
+    Task leftTask = { RunTreeNode, &left, &group };
+    Spawn(&leftTask);
+    RunTreeNode(&right);
+    Wait(&group);
+    node->value = left.value ^ right.value;
+}
+
+void BenchmarkPool(int maxThreads, int tasks)
+{
+    int previousThreads = PoolThreads();
+    ThreadPinning previousPinning = poolPinning;
+
+    int treeDepth = 0;
+    while ((2 << treeDepth) <= tasks)
+        treeDepth++;
+
+    std::vector<uint64_t> values(tasks);
+    std::vector<Task> flat(tasks);
+
+    // The same work without the pool, the overhead per task is the difference
+    for (int i = 0; i < tasks; ++i)
+        values[i] = i + 1;
+    auto serialStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < tasks; ++i)
+        SmallTask(&values[i]);
+    double serialNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - serialStart).count();
+    std::cout << "info string serial: " << serialNs / tasks << " ns per task\n";
+
+    for (int threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        StartPool(threads, previousPinning);
+
+        // Flat: thread 0 spawns every task, the others steal them
+        for (int i = 0; i < tasks; ++i)
+        {
+            values[i] = i + 1;
+            flat[i] = { SmallTask, &values[i], nullptr };
+        }
+        TaskGroup group;
+        auto start = std::chrono::steady_clock::now();
+        for (Task& task : flat)
+        {
+            task.group = &group;
+            Spawn(&task);
+        }
+        Wait(&group);
+        double flatNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        TreeNode root = { treeDepth, 0 };
+        start = std::chrono::steady_clock::now();
+        RunTreeNode(&root);
+        double treeNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "info string pool " << threads << " threads: flat " << tasks << " tasks " << flatNs / tasks
+                  << " ns per task, fork-join " << (1 << treeDepth) << " leaves " << treeNs / (1 << treeDepth) << " ns per leaf\n";
+    }
+
+    StartPool(previousThreads > 0 ? previousThreads : 1, previousPinning);
+}
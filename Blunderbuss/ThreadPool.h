@@ -0,0 +1,59 @@
+#pragma once
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <cstdint>
+
+// Work-stealing job system shared by perft, the search and the tools. Every thread owns a
+// Chase-Lev deque: it pushes and pops its own tasks at the bottom, idle threads steal from
+// the top of others'. Threads that find nothing to steal park until new tasks are spawned.
+// The thread that starts the pool is thread 0 and runs tasks while it waits for them.
+
+// Tasks spawned together, Wait returns once all of them have run
+struct TaskGroup
+{
+    std::atomic<int> pending{0};
+};
+
+// The caller owns the task and keeps it alive until its group has been waited for
+struct Task
+{
+    void (*run)(void* data);
+    void* data;
+    TaskGroup* group;
+};
+
+enum ThreadPinning
+{
+    PIN_NONE,       // the OS schedules the threads
+    PIN_NODES,      // each thread stays on one NUMA node, round-robin
+    PIN_PROCESSORS  // each thread stays on one logical processor
+};
+
+// Starts the pool with the calling thread and threads - 1 workers, stopping a running one first
+void StartPool(int threads, ThreadPinning pinning = PIN_NONE);
+
+void StopPool();
+
+// Threads in the pool, the calling thread included
+int PoolThreads();
+
+// Index of the calling thread in the pool, 0 for the thread that started it
+int PoolThreadIndex();
+
+// Queues a task on the calling thread's deque. Spawned from outside the pool it runs at once.
+void Spawn(Task* task);
+
+// Runs queued tasks, its own and stolen ones, until every task of the group has run
+void Wait(TaskGroup* group);
+
+// Calls run(data) once on every thread of the pool, each on that thread, and returns when all
+// calls are done. For work that depends on where it runs, like first-touching memory on the
+// NUMA node a thread is pinned to. Only thread 0 or a thread outside a running pool may call it.
+void RunOnEveryThread(void (*run)(void* data), void* data);
+
+// Times fine-grained tasks and a fork-join tree on 1, 2, 4... threads up to the given count
+void BenchmarkPool(int maxThreads, int tasks);
+
+#endif // THREADPOOL_H
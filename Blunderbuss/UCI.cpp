@@ -1,18 +1,41 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include "uci.h"
+#include "TT.h"
+#include "ThreadPool.h"
+#include "Pawns.h"
+#include "Material.h"
+#include "Evaluate.h"
+#include "EvalCache.h"
+#include "NNUE.h"
+#include "NNUEKernels.h"
 #include <iostream>
 #include <fstream>
 #include <chrono>
+#include <algorithm>
+#include <memory>
+
+// Formats a search score as the UCI "score" field, "cp <x>" or "mate <moves>"
+static std::string ScoreToString(int score)
+{
+    if (score >= SCORE_MATE_IN_MAX_PLY)
+        return "mate " + std::to_string((SCORE_MATE - score + 1) / 2);
+    if (score <= -SCORE_MATE_IN_MAX_PLY)
+        return "mate " + std::to_string(-(SCORE_MATE + score) / 2);
+    return "cp " + std::to_string(score);
+}
 
 UCI::UCI()
 {
     board = InitBoard();
+    positionFen = START_FEN;
+    TTResize(16);
+    StartPool(1);
 }
 
 UCI::~UCI()
 {
-    // Clean up if necessary
+    StopPool();
 }
 
 void UCI::Run()
@@ -59,6 +82,18 @@ void UCI::Run()
         {
             HandleSetOptionCommand(iss);
         }
+        else if (token == "savehash" || token == "loadhash")
+        {
+            // savehash/loadhash [file], the file defaults to the HashFile option
+            std::string path;
+            std::getline(iss >> std::ws, path);
+            if (path.empty())
+                path = options["HashFile"];
+            if (token == "savehash")
+                SaveHash(path);
+            else
+                LoadHash(path);
+        }
     }
 }
 
@@ -81,6 +116,22 @@ void UCI::SendUciResponse()
 {
     std::cout << "id name Blunderbuss\n";
     std::cout << "id author Kek\n";
+    std::cout << "option name Hash type spin default 16 min 1 max 65536\n";
+    std::cout << "option name Threads type spin default 1 min 1 max 1024\n";
+    std::cout << "option name MultiPV type spin default 1 min 1 max 256\n";
+    std::cout << "option name ParallelSearch type combo default LazySMP var LazySMP var ABDADA\n";
+    std::cout << "option name ThreadPinning type combo default None var None var Nodes var Processors\n";
+    std::cout << "option name HashReplacement type combo default Aged var Aged var Depth var Always\n";
+    std::cout << "option name EvalCache type spin default 1 min 1 max 1024\n";
+    std::cout << "option name Mobility type check default true\n";
+    std::cout << "option name KingSafety type check default true\n";
+    std::cout << "option name Threats type check default true\n";
+    std::cout << "option name LazyEval type check default true\n";
+    std::cout << "option name EvalFile type string default <empty>\n";
+    std::cout << "option name HashFile type string default <empty>\n";
+    std::cout << "option name SharedHash type string default <empty>\n";
+    std::cout << "info string large pages: hash " << (TTLargePages() ? "yes" : "no")
+              << ", attack tables " << (AttackTablesLargePages() ? "yes" : "no") << "\n";
     std::cout << "uciok\n";
     Log("Sent UCI response.");
 }
@@ -93,9 +144,68 @@ void UCI::SendReadyOk()
 
 void UCI::StartNewGame()
 {
+    // A table loaded from disk is kept for the analysis it was saved from, and other
+    // processes may be searching with a shared one
+    if (hashLoaded || TTShared())
+    {
+        hashLoaded = false;
+        std::cout << "info string keeping the " << (TTShared() ? "shared" : "loaded") << " hash\n";
+    }
+    else
+    {
+        auto start = std::chrono::steady_clock::now();
+        TTClear();
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "info string hash cleared in " << ms << " ms with " << threads << " threads\n";
+    }
+    ClearPawnTable();
+    ClearMaterialTable();
+    ClearEvalCache();
     Log("Started new game.");
 }
 
+size_t UCI::HashMegabytes()
+{
+    const std::string& value = options["Hash"];
+    return value.empty() ? 16 : std::stoi(value);
+}
+
+void UCI::AttachSharedHash()
+{
+    // Processes attaching to the same name search with one table, the first sets its size
+    const std::string& name = options["SharedHash"];
+    if (TTAttachShared(name, HashMegabytes()))
+        std::cout << "info string shared hash " << name << ", " << TTSizeMB() << " MB\n";
+    else
+        std::cout << "info string failed to attach shared hash " << name << ", it must be made by this build\n";
+    Log("Attach shared hash " + name + (TTShared() ? " succeeded" : " failed"));
+}
+
+void UCI::SaveHash(const std::string& path)
+{
+    auto start = std::chrono::steady_clock::now();
+    bool saved = !path.empty() && TTSave(path);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    if (saved)
+        std::cout << "info string saved " << TTSizeMB() << " MB hash to " << path << " in " << ms << " ms\n";
+    else
+        std::cout << "info string failed to save hash to " << path << "\n";
+    Log("Save hash to " + path + (saved ? " succeeded" : " failed"));
+}
+
+void UCI::LoadHash(const std::string& path)
+{
+    auto start = std::chrono::steady_clock::now();
+    hashLoaded = !path.empty() && TTLoad(path);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    if (hashLoaded)
+        std::cout << "info string loaded " << TTSizeMB() << " MB hash from " << path << " in " << ms << " ms, large pages "
+                  << (TTLargePages() ? "obtained" : "not available") << "\n";
+    else
+        std::cout << "info string failed to load hash from " << path << ", it must be saved by this build\n";
+    Log("Load hash from " + path + (hashLoaded ? " succeeded" : " failed"));
+}
+
 void UCI::PrintWelcomeMessage()
 {
     std::cout << " ____  _                 _           _                   \n";
@@ -120,19 +230,146 @@ void UCI::HandleSetOptionCommand(std::istringstream& iss)
         }
         else if (token == "value")
         {
-            iss >> option_value;
+            // The value runs to the end of the line, file paths can contain spaces
+            std::getline(iss >> std::ws, option_value);
         }
     }
 
     options[option_name] = option_value;
+
+    if (option_name == "Hash" && !options["SharedHash"].empty())
+    {
+        AttachSharedHash();
+    }
+    else if (option_name == "Hash")
+    {
+        auto start = std::chrono::steady_clock::now();
+        TTResize(std::stoi(option_value));
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "info string hash " << option_value << " MB, large pages " << (TTLargePages() ? "obtained" : "not available")
+                  << ", cleared in " << ms << " ms with " << threads << " threads\n";
+    }
+    else if (option_name == "HashReplacement")
+    {
+        if (option_value == "Depth")
+            replacementOption = TT_REPLACE_DEPTH;
+        else if (option_value == "Always")
+            replacementOption = TT_REPLACE_ALWAYS;
+        else
+            replacementOption = TT_REPLACE_AGED;
+        TTSetReplacement(replacementOption);
+    }
+    else if (option_name == "Threads")
+    {
+        threads = std::max(1, std::stoi(option_value));
+        StartPool(threads, pinning);
+    }
+    else if (option_name == "MultiPV")
+    {
+        multiPV = std::max(1, std::stoi(option_value));
+    }
+    else if (option_name == "ParallelSearch")
+    {
+        parallelMode = option_value == "ABDADA" ? PARALLEL_ABDADA : PARALLEL_LAZY_SMP;
+    }
+    else if (option_name == "ThreadPinning")
+    {
+        if (option_value == "Nodes")
+            pinning = PIN_NODES;
+        else if (option_value == "Processors")
+            pinning = PIN_PROCESSORS;
+        else
+            pinning = PIN_NONE;
+        StartPool(threads, pinning);
+    }
+    else if (option_name == "EvalCache")
+    {
+        ResizeEvalCache(std::stoi(option_value));
+    }
+    else if (option_name == "Mobility")
+    {
+        // Cached scores were computed with the old set of terms
+        evalTerms.mobility = option_value == "true";
+        ClearEvalCache();
+    }
+    else if (option_name == "KingSafety")
+    {
+        evalTerms.kingSafety = option_value == "true";
+        ClearEvalCache();
+    }
+    else if (option_name == "Threats")
+    {
+        evalTerms.threats = option_value == "true";
+        ClearEvalCache();
+    }
+    else if (option_name == "LazyEval")
+    {
+        evalTerms.lazy = option_value == "true";
+        ClearEvalCache();
+    }
+    else if (option_name == "SharedHash")
+    {
+        if (!option_value.empty())
+            AttachSharedHash();
+        else if (TTShared())
+            TTResize(HashMegabytes());
+    }
+    else if (option_name == "HashFile")
+    {
+        // Picks up a table saved by an earlier session, otherwise it is where savehash writes
+        std::ifstream existing(option_value, std::ios::binary);
+        if (existing)
+        {
+            existing.close();
+            LoadHash(option_value);
+        }
+    }
+    else if (option_name == "EvalFile")
+    {
+        if (LoadNetwork(option_value))
+        {
+            RefreshAccumulator(board);
+            ClearEvalCache();
+            std::cout << "info string loaded network " << option_value << " using " << NNUEKernelName() << " kernels\n";
+        }
+        else
+        {
+            std::cout << "info string failed to load network " << option_value << "\n";
+        }
+    }
+
     Log("Set option " + option_name + " to " + option_value);
 }
 
-void UCI::HandleGoCommand(std::istringstream& iss)
+void UCI::HandleGoCommand(std::istringstream& command)
 {
     std::string token;
     std::string value;
 
+    // searchmoves takes the moves up to the next keyword, wherever it stands,
+    // the other parameters are handled in order
+    std::vector<Move> searchMoves;
+    std::string rest;
+    while (command >> token)
+    {
+        if (token != "searchmoves")
+        {
+            rest += token + " ";
+            continue;
+        }
+        while (command >> token)
+        {
+            Move move = StringToMove(board, token);
+            if (move.pieceType == -1)
+            {
+                rest += token + " ";
+                break;
+            }
+            searchMoves.push_back(move);
+        }
+    }
+    std::istringstream iss(rest);
+
     while (iss >> token)
     {
         if (token == "perft")
@@ -140,7 +377,7 @@ void UCI::HandleGoCommand(std::istringstream& iss)
             int depth;
             if (iss >> depth)
             {
-				uint64_t nodes = Perft(board, depth, true);
+				uint64_t nodes = PerftParallel(board, depth);
 				std::cout << "Nodes searched: " << depth << ": " << nodes << "\n";
 				Log("Perft " + std::to_string(depth) + ": " + std::to_string(nodes));
             }
@@ -149,14 +386,197 @@ void UCI::HandleGoCommand(std::istringstream& iss)
                 Log("Invalid perft depth value.");
             }
         }
+        else if (token == "evalcheck")
+        {
+            int depth;
+            if (iss >> depth)
+            {
+                uint64_t mismatches = EvalCheck(board, depth);
+                std::cout << "Eval check " << depth << ": " << mismatches << " mismatches\n";
+                Log("Eval check " + std::to_string(depth) + ": " + std::to_string(mismatches) + " mismatches");
+            }
+            else
+            {
+                Log("Invalid evalcheck depth value.");
+            }
+        }
+        else if (token == "searchcheck")
+        {
+            // go searchcheck <depth> <plies>: searches and plays the best move for the given number
+            // of plies, takes them back and runs the eval check, the searches must leave the
+            // incremental state of the positions they started from as it was
+            int depth, plies;
+            if (iss >> depth >> plies)
+            {
+                std::vector<Snapshot> played;
+                for (int ply = 0; ply < plies; ++ply)
+                {
+                    MoveScore moveScore = IterativeDeepening(depth);
+                    if (moveScore.move.pieceType == -1)
+                        break;
+                    played.push_back(MakeSnapshot(board));
+                    MakeMove(board, moveScore.move);
+                }
+                for (auto it = played.rbegin(); it != played.rend(); ++it)
+                    UnmakeMove(board, *it);
+                uint64_t mismatches = EvalCheck(board, 1);
+                std::cout << "Search check " << depth << ": " << mismatches << " mismatches\n";
+                Log("Search check " + std::to_string(depth) + ": " + std::to_string(mismatches) + " mismatches");
+            }
+            else
+            {
+                Log("Invalid searchcheck arguments.");
+            }
+        }
+        else if (token == "ttbench")
+        {
+            // go ttbench <megabytes> <probes>
+            int megabytes, probes;
+            if (iss >> megabytes >> probes)
+            {
+                TTBenchmark(megabytes, probes);
+            }
+            else
+            {
+                Log("Invalid ttbench arguments.");
+            }
+        }
+        else if (token == "ttreplacebench")
+        {
+            // go ttreplacebench <depth> <plies>: an analysis session that searches the current
+            // position to depth, plays the best move and goes on for the given number of plies,
+            // once with each replacement policy from an empty table. Run it with a Hash small
+            // enough to fill up, entries of earlier searches then compete with the current ones.
+            int depth, plies;
+            if (iss >> depth >> plies)
+            {
+                // Each session plays its moves on a copy, the position set by the GUI is left as it was
+                Board* position = board;
+                const char* names[] = { "aged", "depth", "always" };
+                for (int policy = TT_REPLACE_AGED; policy <= TT_REPLACE_ALWAYS; ++policy)
+                {
+                    TTSetReplacement((TTReplacement)policy);
+                    TTClear();
+                    std::unique_ptr<Board> session(new Board(*position));
+                    board = session.get();
+                    int played = 0;
+                    uint64_t nodes = 0;
+                    auto start = std::chrono::steady_clock::now();
+                    for (; played < plies; ++played)
+                    {
+                        MoveScore moveScore = IterativeDeepening(depth);
+                        nodes += searchStats.nodes;
+                        if (moveScore.move.pieceType == -1)
+                            break;
+                        MakeMove(board, moveScore.move);
+                    }
+                    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+                    board = position;
+                    std::cout << "info string replacement " << names[policy] << ": " << played << " plies to depth "
+                              << depth << " in " << ms << " ms, " << nodes << " nodes\n";
+                }
+                TTSetReplacement(replacementOption);
+            }
+            else
+            {
+                Log("Invalid ttreplacebench arguments.");
+            }
+        }
+        else if (token == "smpbench")
+        {
+            // go smpbench <depth> <max threads>: time to depth of the current position from
+            // an empty hash table with each parallel mode on 1, 2, 4... threads
+            int depth, maxThreads;
+            if (iss >> depth >> maxThreads)
+            {
+                const char* names[] = { "lazy smp", "abdada" };
+                for (int mode = PARALLEL_LAZY_SMP; mode <= PARALLEL_ABDADA; ++mode)
+                {
+                    parallelMode = (ParallelMode)mode;
+                    for (int count = 1; count <= maxThreads; count *= 2)
+                    {
+                        StartPool(count, pinning);
+                        TTClear();
+                        auto start = std::chrono::steady_clock::now();
+                        MoveScore moveScore = IterativeDeepening(depth);
+                        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+                        std::cout << "info string " << names[mode] << " " << count << " threads: depth " << depth << " in "
+                                  << ms << " ms, " << searchStats.nodes << " nodes, best " << MoveToString(moveScore.move) << "\n";
+                    }
+                }
+                StartPool(threads, pinning);
+                parallelMode = options["ParallelSearch"] == "ABDADA" ? PARALLEL_ABDADA : PARALLEL_LAZY_SMP;
+            }
+            else
+            {
+                Log("Invalid smpbench arguments.");
+            }
+        }
+        else if (token == "poolbench")
+        {
+            // go poolbench <max threads> <tasks>
+            int maxThreads, tasks;
+            if (iss >> maxThreads >> tasks)
+            {
+                BenchmarkPool(maxThreads, tasks);
+            }
+            else
+            {
+                Log("Invalid poolbench arguments.");
+            }
+        }
+        else if (token == "kernelbench")
+        {
+            int iterations;
+            if (iss >> iterations)
+            {
+                BenchmarkKernels(iterations);
+            }
+            else
+            {
+                Log("Invalid kernelbench iteration count.");
+            }
+        }
+        else if (token == "lazybench")
+        {
+            // go lazybench <depth>: time to depth of the current position from empty tables with
+            // lazy evaluation off and on, then once more comparing every lazy exit with the full score
+            int depth;
+            if (iss >> depth)
+            {
+                const char* names[] = { "off", "on", "checked" };
+                bool lazy = evalTerms.lazy;
+                for (int run = 0; run < 3; ++run)
+                {
+                    evalTerms.lazy = run > 0;
+                    evalTerms.checkLazy = run == 2;
+                    TTClear();
+                    ClearPawnTable();
+                    ClearEvalCache();
+                    auto start = std::chrono::steady_clock::now();
+                    IterativeDeepening(depth);
+                    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+                    std::cout << "info string lazy " << names[run] << ": depth " << depth << " in " << ms << " ms, "
+                              << searchStats.nodes << " nodes, " << searchStats.lazyEvals << " of " << searchStats.evals
+                              << " evals lazy, " << searchStats.lazyWrong << " wrong, largest error " << searchStats.lazyMaxError << "\n";
+                }
+                evalTerms.lazy = lazy;
+                evalTerms.checkLazy = false;
+            }
+            else
+            {
+                Log("Invalid lazybench depth value.");
+            }
+        }
         else if (token == "depth")
         {
 			if (iss >> value)
 			{
 				int depth = std::stoi(value);
-                MoveScore moveScore = SearchRoot(board, depth);
+                MoveScore moveScore = IterativeDeepening(depth, searchMoves);
+                PrintSearchStats();
 				Log("Searching with depth: " + value);
-				std::cout << "bestmove " << MoveToString(moveScore.move) << " eval: " << moveScore.score << "\n";
+				std::cout << "bestmove " << MoveToString(moveScore.move) << "\n";
 			}
 			else
 			{
@@ -179,19 +599,112 @@ void UCI::HandleGoCommand(std::istringstream& iss)
     }
 }
 
+// Iterative deepening, each iteration seeds the move ordering of the next through the root
+// move list and the hash table
+MoveScore UCI::IterativeDeepening(int depth, const std::vector<Move>& searchMoves)
+{
+    searchStats = SearchStats();
+    TTNewSearch();
+    hashLoaded = false;
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<RootMove> rootMoves = GenerateRootMoves(board, searchMoves);
+    if (rootMoves.empty())
+        return { { -1, -1, -1, 0, 0, -1 }, IsCheck(board, board->turn) ? -SCORE_MATE : 0 };
+
+    int lines = std::min(multiPV, (int)rootMoves.size());
+    for (int d = 1; d <= depth; ++d)
+    {
+        SearchRootParallel(board, d, rootMoves, lines, parallelMode);
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        for (int line = 0; line < lines; ++line)
+        {
+            std::cout << "info depth " << d << " multipv " << line + 1 << " score " << ScoreToString(rootMoves[line].score)
+                      << " nodes " << searchStats.nodes << " nps " << searchStats.nodes * 1000 / (ms + 1)
+                      << " hashfull " << TTHashfull() << " time " << ms << " pv";
+            for (const Move& move : rootMoves[line].pv)
+                std::cout << " " << MoveToString(move);
+            std::cout << "\n";
+        }
+    }
+    std::cout << "info string best move took " << BestMoveEffort(rootMoves) / 10 << "% of the last iteration's root nodes\n";
+    return { rootMoves[0].move, rootMoves[0].score };
+}
+
+void UCI::PrintSearchStats()
+{
+    if (searchStats.pawnProbes > 0)
+    {
+        std::cout << "info string pawn hash hits " << searchStats.pawnHits * 100 / searchStats.pawnProbes
+                  << "% of " << searchStats.pawnProbes << " probes\n";
+    }
+    if (searchStats.evalCacheProbes > 0)
+    {
+        std::cout << "info string eval cache hits " << searchStats.evalCacheHits * 100 / searchStats.evalCacheProbes
+                  << "% of " << searchStats.evalCacheProbes << " probes\n";
+    }
+    if (searchStats.evals > 0)
+    {
+        std::cout << "info string lazy evals " << searchStats.lazyEvals * 100 / searchStats.evals
+                  << "% of " << searchStats.evals << " evals\n";
+    }
+}
+
 void UCI::HandlePositionCommand(std::istringstream& iss)
 {
     std::string token;
+    std::string fen;
+    std::vector<std::string> moves;
 
-    while (iss >> token)
+    iss >> token;
+    if (token == "startpos")
     {
-        if (token == "fen")
+        fen = START_FEN;
+        iss >> token;
+    }
+    else if (token == "fen")
+    {
+        // The FEN runs until the optional "moves" keyword
+        while (iss >> token && token != "moves")
+            fen += (fen.empty() ? "" : " ") + token;
+    }
+    else
+    {
+        Log("Invalid position command.");
+        return;
+    }
+
+    if (token == "moves")
+    {
+        while (iss >> token)
+            moves.push_back(token);
+    }
+
+    // If this continues the previous position, only play the new moves
+    size_t first = 0;
+    if (fen == positionFen
+        && moves.size() >= positionMoves.size()
+        && std::equal(positionMoves.begin(), positionMoves.end(), moves.begin()))
+    {
+        first = positionMoves.size();
+    }
+    else
+    {
+        LoadFEN(board, fen);
+        positionFen = fen;
+        positionMoves.clear();
+        Log("Loaded FEN: " + fen);
+    }
+
+    for (size_t i = first; i < moves.size(); ++i)
+    {
+        Move move = StringToMove(board, moves[i]);
+        if (move.pieceType == -1)
         {
-            //read the fen and call LoadFen
-			std::string fen;
-			std::getline(iss, fen);
-			LoadFEN(board, fen);
-			Log("Loaded FEN: " + fen);
-		}
+            Log("Illegal move in position command: " + moves[i]);
+            break;
+        }
+        MakeMove(board, move);
+        positionMoves.push_back(moves[i]);
     }
 }
\ No newline at end of file
@@ -2,8 +2,11 @@
 
 #include <string>
 #include <map>
+#include <vector>
 #include <sstream>
 #include "Board.h"
+#include "TT.h"
+#include "ThreadPool.h"
 
 class UCI
 {
@@ -16,13 +19,29 @@ private:
     Board* board;
     std::map<std::string, std::string> options;
     std::string logFile = "log_file.txt";
+    int threads = 1; // size of the thread pool, also clears the hash table in parallel
+    ThreadPinning pinning = PIN_NONE;
+    ParallelMode parallelMode = PARALLEL_LAZY_SMP;
+    int multiPV = 1; // lines reported per iteration
+    TTReplacement replacementOption = TT_REPLACE_AGED;
+    bool hashLoaded = false; // a ucinewgame before the first search keeps the loaded table
+
+    // The last position command, so a following one that only adds moves can be applied incrementally
+    std::string positionFen;
+    std::vector<std::string> positionMoves;
 
     void Log(const std::string& message);
     void SendUciResponse();
     void SendReadyOk();
     void StartNewGame();
     void PrintWelcomeMessage();
+    size_t HashMegabytes();
+    void AttachSharedHash();
+    void SaveHash(const std::string& path);
+    void LoadHash(const std::string& path);
     void HandleSetOptionCommand(std::istringstream& iss);
     void HandleGoCommand(std::istringstream& iss);
     void HandlePositionCommand(std::istringstream& iss);
+    MoveScore IterativeDeepening(int depth, const std::vector<Move>& searchMoves = {});
+    void PrintSearchStats();
 };